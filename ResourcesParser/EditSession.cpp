@@ -0,0 +1,470 @@
+#include "EditSession.h"
+
+#include <iostream>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+typedef ResourcesParser::byte byte;
+
+// 除了 size 以外的字段都一样
+static bool isSameConfig(const ResTable_config& a, const ResTable_config& b) {
+	return memcmp((const byte*)&a + sizeof(uint32_t),
+			(const byte*)&b + sizeof(uint32_t),
+			sizeof(ResTable_config) - sizeof(uint32_t)) == 0;
+}
+
+uint32_t EditSession::add(
+		const string& pkgName,
+		const string& type,
+		const string& key,
+		const string& value) {
+	Value newValue = { Res_value::TYPE_STRING, 0, true, value };
+	return add(pkgName, type, key, newValue);
+}
+
+uint32_t EditSession::add(
+		const string& pkgName,
+		const string& type,
+		const string& key,
+		uint8_t dataType,
+		uint32_t data) {
+	Value newValue = { dataType, data, false, "" };
+	return add(pkgName, type, key, newValue);
+}
+
+uint32_t EditSession::add(const string& pkgName, const string& type, const string& key, const Value& value) {
+	ResourcesParser::PackageResourcePtr pPackage = nullptr;
+	const map<string, ResourcesParser::PackageResourcePtr>& packages = mParser->getResourceForPackageName();
+	if(pkgName.empty()) {
+		if(!packages.empty()) {
+			pPackage = packages.begin()->second;
+		}
+	} else if(packages.find(pkgName) != packages.end()) {
+		pPackage = packages.find(pkgName)->second;
+	}
+	if(pPackage == nullptr || key.empty()) {
+		return 0;
+	}
+	uint32_t typeIdx = pPackage->pTypes->getStrIdx(type);
+	if(typeIdx == (uint32_t)-1) {
+		return 0;
+	}
+	const uint32_t typeKey = (pPackage->header.id << 8) | (typeIdx + 1);
+
+	auto it = mTypeEdits.find(typeKey);
+	if(it == mTypeEdits.end()) {
+		const ResourcesParser::TypeIndex* pIndex = mParser->getTypeIndexForId(typeKey << 16);
+		if(pIndex == nullptr || pIndex->pResTableTypes->empty()) {
+			return 0;
+		}
+		TypeEdit typeEdit;
+		typeEdit.pPackage = pPackage;
+		typeEdit.typeId = typeIdx + 1;
+		typeEdit.pTarget = (*pIndex->pResTableTypes)[0];
+		for(ResourcesParser::ResTableTypePtr pResTableType : *pIndex->pResTableTypes) {
+			if(pResTableType->header.config.toString().empty()) {
+				typeEdit.pTarget = pResTableType;
+				break;
+			}
+		}
+		typeEdit.nextEntryId = pIndex->entryCount;
+		it = mTypeEdits.insert(make_pair(typeKey, typeEdit)).first;
+	}
+	TypeEdit& typeEdit = it->second;
+	if(typeEdit.nextEntryId > 0xFFFF) {
+		return 0;
+	}
+	NewEntry newEntry = { typeEdit.nextEntryId++, key, value };
+	typeEdit.newEntries.push_back(newEntry);
+	return (typeKey << 16) | newEntry.entryId;
+}
+
+bool EditSession::remove(uint32_t id) {
+	if(mParser->getFirstEntryForId(id) == nullptr) {
+		return false;
+	}
+	return mRemoved.insert(id).second;
+}
+
+bool EditSession::setValue(uint32_t id, const string& config, const string& value) {
+	Value newValue = { Res_value::TYPE_STRING, 0, true, value };
+	return setValue(id, config, newValue);
+}
+
+bool EditSession::setValue(uint32_t id, const string& config, uint8_t dataType, uint32_t data) {
+	Value newValue = { dataType, data, false, "" };
+	return setValue(id, config, newValue);
+}
+
+bool EditSession::setValue(uint32_t id, const string& config, const Value& value) {
+	ResTable_config target;
+	if(!target.fromString(config)) {
+		return false;
+	}
+	const ResourcesParser::TypeIndex* pIndex = mParser->getTypeIndexForId(id);
+	if(pIndex == nullptr) {
+		return false;
+	}
+	const vector<ResourcesParser::ResTableTypePtr>& resTableTypePtrs = *pIndex->pResTableTypes;
+	for(uint32_t i = 0 ; i < resTableTypePtrs.size() ; i++) {
+		if(!pIndex->hasConfig(ENTRY_ID(id), i) || !isSameConfig(resTableTypePtrs[i]->header.config, target)) {
+			continue;
+		}
+		ResourcesParser::ResTableTypePtr pResTableType = resTableTypePtrs[i];
+		pResTableType->load();
+		if(pResTableType->entries[ENTRY_ID(id)]->flags & ResTable_entry::FLAG_COMPLEX) {
+			return false;
+		}
+		ValueChange change = { id >> 16, pResTableType, value };
+		mValueChanges[make_pair(pResTableType.get(), ENTRY_ID(id))] = change;
+		return true;
+	}
+	return false;
+}
+
+size_t EditSession::size() const {
+	size_t count = mRemoved.size() + mValueChanges.size();
+	for(auto& item : mTypeEdits) {
+		count += item.second.newEntries.size();
+	}
+	return count;
+}
+
+void EditSession::commit() {
+	// 全局字符串池: 新 entry 和改值用到的字符串一次追加. 已经有的直接复用,
+	// 但不能复用带 style 的(index < styleCount), 否则值就变成带格式的了
+	ResourcesParser::ResStringPoolPtr pGlobal = mParser->mGlobalStringPool;
+	map<string, uint32_t> globalIndices;
+	vector<string> newGlobalStrs;
+	auto internGlobal = [&](const Value& value) {
+		if(!value.isString || globalIndices.find(value.str) != globalIndices.end()) {
+			return;
+		}
+		uint32_t idx = pGlobal->getStrIdx(value.str);
+		if(idx == (uint32_t)-1 || idx < pGlobal->header.styleCount) {
+			idx = pGlobal->header.stringCount + newGlobalStrs.size();
+			newGlobalStrs.push_back(value.str);
+		}
+		globalIndices[value.str] = idx;
+	};
+	for(auto& item : mTypeEdits) {
+		for(const NewEntry& newEntry : item.second.newEntries) {
+			internGlobal(newEntry.value);
+		}
+	}
+	for(auto& item : mValueChanges) {
+		internGlobal(item.second.value);
+	}
+	int64_t fileDelta = pGlobal->addNewStrings(newGlobalStrs);
+
+	// key 字符串池: 每个 package 一次追加, 同一个 package 的 type 在 mTypeEdits 里是挨着的
+	map<ResourcesParser::PackageResource*, int64_t> packageDeltas;
+	map<uint32_t, vector<uint32_t> > newKeyIndices;
+	for(auto it = mTypeEdits.begin() ; it != mTypeEdits.end() ; ) {
+		ResourcesParser::PackageResourcePtr pPackage = it->second.pPackage;
+		map<string, uint32_t> keyIndices;
+		vector<string> newKeys;
+		auto first = it;
+		for(; it != mTypeEdits.end() && it->second.pPackage == pPackage ; ++it) {
+			for(const NewEntry& newEntry : it->second.newEntries) {
+				if(keyIndices.find(newEntry.key) != keyIndices.end()) {
+					continue;
+				}
+				uint32_t idx = pPackage->pKeys->getStrIdx(newEntry.key);
+				if(idx == (uint32_t)-1) {
+					idx = pPackage->pKeys->header.stringCount + newKeys.size();
+					newKeys.push_back(newEntry.key);
+				}
+				keyIndices[newEntry.key] = idx;
+			}
+		}
+		packageDeltas[pPackage.get()] += pPackage->pKeys->addNewStrings(newKeys);
+		for(auto typeIt = first ; typeIt != it ; ++typeIt) {
+			vector<uint32_t>& indices = newKeyIndices[typeIt->first];
+			for(const NewEntry& newEntry : typeIt->second.newEntries) {
+				indices.push_back(keyIndices[newEntry.key]);
+			}
+		}
+	}
+
+	// 找出所有要重建的 config: 新增 entry 的目标 config, 改了值的 config, 删除的 entry 所在的 config
+	map<ResourcesParser::ResTableType*, pair<uint32_t, ResourcesParser::ResTableTypePtr> > touched;
+	for(auto& item : mTypeEdits) {
+		touched[item.second.pTarget.get()] = make_pair(item.first, item.second.pTarget);
+	}
+	for(auto& item : mValueChanges) {
+		touched[item.first.first] = make_pair(item.second.typeKey, item.second.pResTableType);
+	}
+	for(uint32_t id : mRemoved) {
+		const ResourcesParser::TypeIndex* pIndex = mParser->getTypeIndexForId(id);
+		for(uint32_t i = 0 ; i < pIndex->pResTableTypes->size() ; i++) {
+			if(pIndex->hasConfig(ENTRY_ID(id), i)) {
+				ResourcesParser::ResTableTypePtr pResTableType = (*pIndex->pResTableTypes)[i];
+				touched[pResTableType.get()] = make_pair(id >> 16, pResTableType);
+			}
+		}
+	}
+
+	static const vector<uint32_t> NO_KEYS;
+	set<uint32_t> touchedTypes;
+	for(auto& item : touched) {
+		const uint32_t typeKey = item.second.first;
+		auto typeEdit = mTypeEdits.find(typeKey);
+		auto keyIndices = newKeyIndices.find(typeKey);
+		int64_t delta = rebuildResTableType(
+				typeKey,
+				item.second.second,
+				typeEdit != mTypeEdits.end() ? &typeEdit->second : nullptr,
+				keyIndices != newKeyIndices.end() ? keyIndices->second : NO_KEYS,
+				globalIndices);
+		packageDeltas[mParser->getPackageResouceForId(typeKey << 16).get()] += delta;
+		touchedTypes.insert(typeKey);
+	}
+	for(auto& item : mTypeEdits) {
+		packageDeltas[item.second.pPackage.get()] +=
+			growTypeSpec(item.second.pPackage, item.second.typeId, item.second.nextEntryId);
+	}
+
+	// 最后统一更新 package 和整个文件的大小
+	for(auto& item : packageDeltas) {
+		item.first->header.header.size += item.second;
+		fileDelta += item.second;
+	}
+	mParser->mResourcesInfo.header.size += fileDelta;
+	for(uint32_t typeKey : touchedTypes) {
+		mParser->invalidateTypeIndex(typeKey << 16);
+	}
+
+	mTypeEdits.clear();
+	mRemoved.clear();
+	mValueChanges.clear();
+}
+
+uint32_t EditSession::getInPlaceOffset(const ValueKey& key) {
+	ResourcesParser::ResTableType* pResTableType = key.first;
+	const uint32_t entryId = key.second;
+	pResTableType->load();
+	// entry 表被改过(容量不为 0)的话, 内存里的位置和文件里的对不上
+	const ResourcesParser::EntryPool& pool = pResTableType->entryPool;
+	if(pResTableType->pSource != mParser->mFile || pool.offsetCapacity != 0 || pool.dataCapacity != 0) {
+		return 0;
+	}
+	// 和别的 id 共用的数据原地改了会连别的 id 一起改掉
+	const ResTable_entry* pEntry = pResTableType->entries[entryId];
+	for(uint32_t i = 0 ; i < pResTableType->entries.size() ; i++) {
+		if(i != entryId && pResTableType->entries[i] == pEntry) {
+			return 0;
+		}
+	}
+	return pResTableType->chunkOffset
+		+ pResTableType->header.entriesStart
+		+ ((const byte*)pEntry - pool.pData.get())
+		+ pEntry->size;
+}
+
+bool EditSession::isInPlace() {
+	// 文件大小没变说明 parser 加载之后没有追加过字符串或者 entry
+	if(!mTypeEdits.empty()
+			|| !mRemoved.empty()
+			|| mParser->mFile == nullptr
+			|| mParser->mResourcesInfo.header.size != mParser->mFile->size()) {
+		return false;
+	}
+	ResourcesParser::ResStringPoolPtr pGlobal = mParser->mGlobalStringPool;
+	for(auto& item : mValueChanges) {
+		const Value& value = item.second.value;
+		if(value.isString) {
+			uint32_t idx = pGlobal->getStrIdx(value.str);
+			if(idx == (uint32_t)-1 || idx < pGlobal->header.styleCount) {
+				return false;
+			}
+		}
+		if(getInPlaceOffset(item.first) == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int64_t EditSession::commitInPlace(const string& destPath) {
+	if(!isInPlace()) {
+		return -1;
+	}
+	int fd = open(destPath.c_str(), O_WRONLY);
+	if(fd < 0) {
+		cout <<"can't open " <<destPath <<": " <<strerror(errno) <<endl;
+		return -1;
+	}
+	// 目标文件必须是原文件或者它的拷贝
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (uint64_t)st.st_size != mParser->mFile->size()) {
+		cout <<destPath <<" is not a copy of the parsed file" <<endl;
+		close(fd);
+		return -1;
+	}
+
+	int64_t written = 0;
+	for(auto& item : mValueChanges) {
+		const Value& value = item.second.value;
+		Res_value patched = *item.first.first->values[item.first.second];
+		patched.dataType = value.dataType;
+		patched.data = value.isString ? mParser->mGlobalStringPool->getStrIdx(value.str) : value.data;
+		const uint32_t offset = getInPlaceOffset(item.first);
+		if(pwrite(fd, &patched, sizeof(Res_value), offset) != sizeof(Res_value)) {
+			cout <<"write " <<destPath <<" failed: " <<strerror(errno) <<endl;
+			close(fd);
+			return -1;
+		}
+		written += sizeof(Res_value);
+	}
+	if(close(fd) != 0) {
+		return -1;
+	}
+	commit();
+	return written;
+}
+
+int64_t EditSession::rebuildResTableType(
+		uint32_t typeKey,
+		ResourcesParser::ResTableTypePtr pResTableType,
+		const TypeEdit* pTypeEdit,
+		const vector<uint32_t>& newKeyIndices,
+		const map<string, uint32_t>& globalIndices) {
+	pResTableType->load();
+	const bool isTarget = pTypeEdit != nullptr && pTypeEdit->pTarget == pResTableType;
+	const uint32_t oldCount = pResTableType->entries.size();
+	const uint32_t newCount = isTarget ? max(oldCount, pTypeEdit->nextEntryId) : oldCount;
+	const uint32_t newEntrySize = sizeof(ResTable_entry) + sizeof(Res_value);
+
+	// 先排好每个 entry 的新位置, 算出最终大小. 多个 id 共用的同一份数据继续共用, 除非要改值
+	struct Copy {
+		const ResTable_entry* pEntry;
+		uint32_t size;
+		uint32_t offset;
+		const Value* pValue;
+	};
+	vector<uint32_t> offsets(newCount, ResTable_type::NO_ENTRY);
+	vector<Copy> copies;
+	map<const ResTable_entry*, uint32_t> shared;
+	uint32_t dataSize = 0;
+	for(uint32_t entryId = 0 ; entryId < oldCount ; entryId++) {
+		const ResTable_entry* pEntry = pResTableType->entries[entryId];
+		if(pEntry == nullptr || mRemoved.find((typeKey << 16) | entryId) != mRemoved.end()) {
+			continue;
+		}
+		auto change = mValueChanges.find(make_pair(pResTableType.get(), entryId));
+		const Value* pValue = change != mValueChanges.end() ? &change->second.value : nullptr;
+		if(pValue == nullptr) {
+			auto sharedIt = shared.find(pEntry);
+			if(sharedIt != shared.end()) {
+				offsets[entryId] = sharedIt->second;
+				continue;
+			}
+			shared[pEntry] = dataSize;
+		}
+		Copy copy = { pEntry, ResourcesParser::getEntrySize(pEntry), dataSize, pValue };
+		copies.push_back(copy);
+		offsets[entryId] = dataSize;
+		dataSize += copy.size;
+	}
+	const uint32_t newEntriesStart = dataSize;
+	if(isTarget) {
+		for(const NewEntry& newEntry : pTypeEdit->newEntries) {
+			offsets[newEntry.entryId] = dataSize;
+			dataSize += newEntrySize;
+		}
+	}
+
+	shared_ptr<uint32_t> pOffsets(new uint32_t[max(newCount, 1u)], default_delete<uint32_t[]>());
+	memcpy(pOffsets.get(), offsets.data(), newCount * sizeof(uint32_t));
+	shared_ptr<byte> pData(new byte[max(dataSize, 1u)], default_delete<byte[]>());
+	for(const Copy& copy : copies) {
+		memcpy(pData.get() + copy.offset, copy.pEntry, copy.size);
+		if(copy.pValue != nullptr) {
+			ResTable_entry* pEntry = (ResTable_entry*)(pData.get() + copy.offset);
+			Res_value* pValue = ResourcesParser::getValueFromEntry(pEntry);
+			pValue->dataType = copy.pValue->dataType;
+			pValue->data = copy.pValue->isString ? globalIndices.at(copy.pValue->str) : copy.pValue->data;
+		}
+	}
+	if(isTarget) {
+		byte* pNew = pData.get() + newEntriesStart;
+		for(uint32_t i = 0 ; i < pTypeEdit->newEntries.size() ; i++, pNew += newEntrySize) {
+			const NewEntry& newEntry = pTypeEdit->newEntries[i];
+			ResTable_entry* pEntry = (ResTable_entry*)pNew;
+			pEntry->size = sizeof(ResTable_entry);
+			pEntry->flags = 0;
+			pEntry->key.index = newKeyIndices[i];
+			Res_value* pValue = (Res_value*)(pNew + sizeof(ResTable_entry));
+			pValue->size = sizeof(Res_value);
+			pValue->res0 = 0;
+			pValue->dataType = newEntry.value.dataType;
+			pValue->data = newEntry.value.isString ? globalIndices.at(newEntry.value.str) : newEntry.value.data;
+		}
+	}
+
+	// 换上新的 entry 表, 缓冲区大小正好是最终大小
+	pResTableType->isDirty = true;
+	ResourcesParser::EntryPool& pool = pResTableType->entryPool;
+	pool.pOffsets = pOffsets;
+	pool.pData = pData;
+	pool.offsetCount = newCount;
+	pool.offsetCapacity = max(newCount, 1u);
+	pool.dataSize = dataSize;
+	pool.dataCapacity = max(dataSize, 1u);
+	pool.isSparse = false;
+	pool.isOffset16 = false;
+
+	ResTable_type& header = pResTableType->header;
+	const uint32_t oldSize = header.header.size;
+	header.flags &= ~(ResTable_type::FLAG_SPARSE | ResTable_type::FLAG_OFFSET16);
+	header.entryCount = newCount;
+	header.entriesStart = header.header.headerSize + sizeof(uint32_t) * newCount;
+	header.header.size = header.entriesStart + dataSize;
+
+	pResTableType->entries.assign(newCount, nullptr);
+	pResTableType->values.assign(newCount, nullptr);
+	for(uint32_t entryId = 0 ; entryId < newCount ; entryId++) {
+		ResTable_entry* pEntry = ResourcesParser::getEntryFromEntryPool(pool, entryId);
+		if(pEntry != nullptr) {
+			pResTableType->entries[entryId] = pEntry;
+			pResTableType->values[entryId] = ResourcesParser::getValueFromEntry(pEntry);
+		}
+	}
+	return (int64_t)header.header.size - oldSize;
+}
+
+int64_t EditSession::growTypeSpec(ResourcesParser::PackageResourcePtr pPackage, uint32_t typeId, uint32_t entryCount) {
+	for(ResourcesParser::ChunkInfo& chunk : pPackage->chunks) {
+		if(chunk.type != RES_TABLE_TYPE_SPEC_TYPE || chunk.pResTableUnknown == nullptr) {
+			continue;
+		}
+		const ResTable_typeSpec* pSpec = (const ResTable_typeSpec*)chunk.pResTableUnknown->pChunkAllData.get();
+		if(pSpec->id != typeId) {
+			continue;
+		}
+		if(pSpec->entryCount >= entryCount) {
+			return 0;
+		}
+		// 新 entry 的 config 掩码都是 0, 追加在原来的掩码数组后面
+		const uint32_t oldSize = pSpec->header.size;
+		const uint32_t newSize = pSpec->header.headerSize + sizeof(uint32_t) * entryCount;
+		shared_ptr<byte> pData(new byte[newSize], default_delete<byte[]>());
+		memset(pData.get(), 0, newSize);
+		memcpy(pData.get(), pSpec, min(oldSize, newSize));
+		ResTable_typeSpec* pNewSpec = (ResTable_typeSpec*)pData.get();
+		pNewSpec->entryCount = entryCount;
+		pNewSpec->header.size = newSize;
+		chunk.pResTableUnknown->pChunkAllData = pData;
+		chunk.pResTableUnknown->isDirty = true;
+		chunk.size = newSize;
+		return (int64_t)newSize - oldSize;
+	}
+	return 0;
+}
@@ -0,0 +1,122 @@
+#ifndef EDIT_SESSION_H
+#define EDIT_SESSION_H
+
+#include "ResourceTypes.h"
+#include "ResourcesParser.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <stdint.h>
+
+/**
+ * 批量修改 ResourcesParser: 先记录所有的新增/删除/改值, commit() 的时候一次算好
+ * 最终的字符串池, entry 表和各个 chunk 的大小.
+ *
+ * 每个字符串池只追加一次, 每个涉及到的 ResTableType 只按最终大小重建一次 entry 表,
+ * package/文件的大小最后统一加上各个 chunk 的变化量, 不会像逐个 addResKeyStr 那样每次都重新分配.
+ *
+ * 新增的 entry 放在 type 的默认 config 里(没有默认 config 时用第一个), id 接在这个 type
+ * 现有的最大 entry id 后面, 同时扩大 type spec 的 entryCount. 不能新建 type.
+ * 删除只是把所有 config 里的 entry 去掉, id 不会被复用, 字符串池里的字符串也不删除.
+ */
+class EditSession {
+public:
+	EditSession(ResourcesParser* parser) : mParser(parser) {  }
+
+	// 新增一个值是字符串的 entry. 返回 commit() 之后的 id, package/type 不存在时返回 0
+	uint32_t add(
+			const std::string& pkgName,
+			const std::string& type,
+			const std::string& key,
+			const std::string& value);
+
+	uint32_t add(
+			const std::string& pkgName,
+			const std::string& type,
+			const std::string& key,
+			uint8_t dataType,
+			uint32_t data);
+
+	// 删除所有 config 里的这个 entry, 不存在时返回 false
+	bool remove(uint32_t id);
+
+	// 修改 config(限定符字符串, 空字符串是默认 config)里这个 entry 的值, entry 必须是简单值
+	bool setValue(uint32_t id, const std::string& config, const std::string& value);
+
+	bool setValue(uint32_t id, const std::string& config, uint8_t dataType, uint32_t data);
+
+	// 应用所有记录下来的修改并清空
+	void commit();
+
+	// 所有修改都能原地完成: 只有改值, 字符串值已经在全局字符串池里, 改的数据没有和别的 id 共用,
+	// 并且 parser 加载之后没有改过大小. 这时每个 chunk 的大小都不变
+	bool isInPlace();
+
+	// isInPlace() 时只把改动的 Res_value pwrite 到 destPath(原文件, 或者原文件的一份拷贝),
+	// 然后像 commit() 一样更新内存, 返回写入的字节数. 不能原地完成或者写失败返回 -1, 修改都保留
+	int64_t commitInPlace(const std::string& destPath);
+
+	// 还没有 commit 的修改数
+	size_t size() const;
+
+private:
+	struct Value {
+		uint8_t dataType;
+		uint32_t data;
+		// dataType 是 TYPE_STRING 并且 isString 时, data 在 commit 时换成 str 在全局字符串池里的 index
+		bool isString;
+		std::string str;
+	};
+
+	struct NewEntry {
+		uint32_t entryId;
+		std::string key;
+		Value value;
+	};
+
+	// 一个 type 里新增的 entry
+	struct TypeEdit {
+		ResourcesParser::PackageResourcePtr pPackage;
+		uint32_t typeId;
+		ResourcesParser::ResTableTypePtr pTarget;
+		uint32_t nextEntryId;
+		std::vector<NewEntry> newEntries;
+	};
+
+	struct ValueChange {
+		uint32_t typeKey;
+		ResourcesParser::ResTableTypePtr pResTableType;
+		Value value;
+	};
+
+	// (config, entry id)
+	typedef std::pair<ResourcesParser::ResTableType*, uint32_t> ValueKey;
+
+	ResourcesParser* mParser;
+	// typeKey 是 id 的 package + type 部分, 也就是 id >> 16
+	std::map<uint32_t, TypeEdit> mTypeEdits;
+	std::set<uint32_t> mRemoved;
+	std::map<ValueKey, ValueChange> mValueChanges;
+
+	uint32_t add(const std::string& pkgName, const std::string& type, const std::string& key, const Value& value);
+
+	bool setValue(uint32_t id, const std::string& config, const Value& value);
+
+	// 原地修改时 Res_value 在文件里的位置, 不能原地修改返回 0
+	uint32_t getInPlaceOffset(const ValueKey& key);
+
+	// 重建一个 config 的 entry 表, 返回 chunk 大小的变化量
+	int64_t rebuildResTableType(
+			uint32_t typeKey,
+			ResourcesParser::ResTableTypePtr pResTableType,
+			const TypeEdit* pTypeEdit,
+			const std::vector<uint32_t>& newKeyIndices,
+			const std::map<std::string, uint32_t>& globalIndices);
+
+	// type spec 的 entryCount 扩大到 entryCount, 返回 chunk 大小的变化量
+	static int64_t growTypeSpec(ResourcesParser::PackageResourcePtr pPackage, uint32_t typeId, uint32_t entryCount);
+};
+
+#endif  /*EDIT_SESSION_H*/
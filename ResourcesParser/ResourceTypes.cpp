@@ -18,6 +18,9 @@
 #include "ByteOrder.h"
 
 #include "sstream"
+#include <vector>
+#include <cstdlib>
+#include <cctype>
 
 using namespace std;
 
@@ -314,3 +317,514 @@ string ResTable_config::toString() const {
     return res.toStdString();
 }
 
+
+static bool parseNumber(const string& str, size_t start, size_t end, int* out) {
+    if (start >= end || end > str.size()) return false;
+    for (size_t i = start; i < end; i++) {
+        if (!isdigit((unsigned char)str[i])) return false;
+    }
+    *out = atoi(str.substr(start, end - start).c_str());
+    return true;
+}
+
+static bool endsWith(const string& str, const string& suffix) {
+    return str.size() >= suffix.size()
+            && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool ResTable_config::fromString(const string& qualifiers) {
+    memset(this, 0, sizeof(ResTable_config));
+    size = sizeof(ResTable_config);
+
+    vector<string> parts;
+    size_t start = 0;
+    while (start <= qualifiers.size()) {
+        size_t end = qualifiers.find('-', start);
+        if (end == string::npos) end = qualifiers.size();
+        if (end > start) parts.push_back(qualifiers.substr(start, end - start));
+        start = end + 1;
+    }
+
+    for (size_t i = 0; i < parts.size(); i++) {
+        const string& raw = parts[i];
+        string part = raw;
+        for (size_t j = 0; j < part.size(); j++) {
+            part[j] = tolower((unsigned char)part[j]);
+        }
+        int num = 0;
+
+        if (part == "default" || part == "any") {
+            continue;
+        } else if (part.compare(0, 3, "mcc") == 0 && parseNumber(part, 3, part.size(), &num)) {
+            mcc = num;
+        } else if (part.compare(0, 3, "mnc") == 0 && parseNumber(part, 3, part.size(), &num)) {
+            mnc = num;
+        } else if (part == "ldltr") {
+            screenLayout = (screenLayout&~MASK_LAYOUTDIR) | LAYOUTDIR_LTR;
+        } else if (part == "ldrtl") {
+            screenLayout = (screenLayout&~MASK_LAYOUTDIR) | LAYOUTDIR_RTL;
+        } else if (part.compare(0, 2, "sw") == 0 && endsWith(part, "dp")
+                && parseNumber(part, 2, part.size() - 2, &num)) {
+            smallestScreenWidthDp = num;
+        } else if (part[0] == 'w' && endsWith(part, "dp")
+                && parseNumber(part, 1, part.size() - 2, &num)) {
+            screenWidthDp = num;
+        } else if (part[0] == 'h' && endsWith(part, "dp")
+                && parseNumber(part, 1, part.size() - 2, &num)) {
+            screenHeightDp = num;
+        } else if (part == "small") {
+            screenLayout = (screenLayout&~MASK_SCREENSIZE) | SCREENSIZE_SMALL;
+        } else if (part == "normal") {
+            screenLayout = (screenLayout&~MASK_SCREENSIZE) | SCREENSIZE_NORMAL;
+        } else if (part == "large") {
+            screenLayout = (screenLayout&~MASK_SCREENSIZE) | SCREENSIZE_LARGE;
+        } else if (part == "xlarge") {
+            screenLayout = (screenLayout&~MASK_SCREENSIZE) | SCREENSIZE_XLARGE;
+        } else if (part == "long") {
+            screenLayout = (screenLayout&~MASK_SCREENLONG) | SCREENLONG_YES;
+        } else if (part == "notlong") {
+            screenLayout = (screenLayout&~MASK_SCREENLONG) | SCREENLONG_NO;
+        } else if (part == "port") {
+            orientation = ORIENTATION_PORT;
+        } else if (part == "land") {
+            orientation = ORIENTATION_LAND;
+        } else if (part == "square") {
+            orientation = ORIENTATION_SQUARE;
+        } else if (part == "desk") {
+            uiMode = (uiMode&~MASK_UI_MODE_TYPE) | UI_MODE_TYPE_DESK;
+        } else if (part == "car") {
+            uiMode = (uiMode&~MASK_UI_MODE_TYPE) | UI_MODE_TYPE_CAR;
+        } else if (part == "television") {
+            uiMode = (uiMode&~MASK_UI_MODE_TYPE) | UI_MODE_TYPE_TELEVISION;
+        } else if (part == "appliance") {
+            uiMode = (uiMode&~MASK_UI_MODE_TYPE) | UI_MODE_TYPE_APPLIANCE;
+        } else if (part == "night") {
+            uiMode = (uiMode&~MASK_UI_MODE_NIGHT) | UI_MODE_NIGHT_YES;
+        } else if (part == "notnight") {
+            uiMode = (uiMode&~MASK_UI_MODE_NIGHT) | UI_MODE_NIGHT_NO;
+        } else if (part == "ldpi") {
+            density = DENSITY_LOW;
+        } else if (part == "mdpi") {
+            density = DENSITY_MEDIUM;
+        } else if (part == "tvdpi") {
+            density = DENSITY_TV;
+        } else if (part == "hdpi") {
+            density = DENSITY_HIGH;
+        } else if (part == "xhdpi") {
+            density = DENSITY_XHIGH;
+        } else if (part == "xxhdpi") {
+            density = DENSITY_XXHIGH;
+        } else if (part == "xxxhdpi") {
+            density = DENSITY_XXXHIGH;
+        } else if (part == "nodpi") {
+            density = DENSITY_NONE;
+        } else if (endsWith(part, "dpi") && parseNumber(part, 0, part.size() - 3, &num)) {
+            density = num;
+        } else if (part == "notouch") {
+            touchscreen = TOUCHSCREEN_NOTOUCH;
+        } else if (part == "stylus") {
+            touchscreen = TOUCHSCREEN_STYLUS;
+        } else if (part == "finger") {
+            touchscreen = TOUCHSCREEN_FINGER;
+        } else if (part == "keysexposed") {
+            inputFlags = (inputFlags&~MASK_KEYSHIDDEN) | KEYSHIDDEN_NO;
+        } else if (part == "keyshidden") {
+            inputFlags = (inputFlags&~MASK_KEYSHIDDEN) | KEYSHIDDEN_YES;
+        } else if (part == "keyssoft") {
+            inputFlags = (inputFlags&~MASK_KEYSHIDDEN) | KEYSHIDDEN_SOFT;
+        } else if (part == "nokeys") {
+            keyboard = KEYBOARD_NOKEYS;
+        } else if (part == "qwerty") {
+            keyboard = KEYBOARD_QWERTY;
+        } else if (part == "12key") {
+            keyboard = KEYBOARD_12KEY;
+        } else if (part == "navexposed" || part == "navsexposed") {
+            inputFlags = (inputFlags&~MASK_NAVHIDDEN) | NAVHIDDEN_NO;
+        } else if (part == "navhidden") {
+            inputFlags = (inputFlags&~MASK_NAVHIDDEN) | NAVHIDDEN_YES;
+        } else if (part == "nonav") {
+            navigation = NAVIGATION_NONAV;
+        } else if (part == "dpad") {
+            navigation = NAVIGATION_DPAD;
+        } else if (part == "trackball") {
+            navigation = NAVIGATION_TRACKBALL;
+        } else if (part == "wheel") {
+            navigation = NAVIGATION_WHEEL;
+        } else if (part[0] == 'v' && parseNumber(part, 1, part.size(), &num)) {
+            sdkVersion = num;
+        } else if (part.find('x') != string::npos
+                && parseNumber(part, 0, part.find('x'), &num)) {
+            int height = 0;
+            if (!parseNumber(part, part.find('x') + 1, part.size(), &height)) return false;
+            screenWidth = num;
+            screenHeight = height;
+        } else if (part.size() == 2 && isalpha((unsigned char)part[0]) && isalpha((unsigned char)part[1])
+                && language[0] == 0) {
+            language[0] = part[0];
+            language[1] = part[1];
+        } else if (part.size() == 3 && part[0] == 'r' && language[0] != 0
+                && isalpha((unsigned char)part[1]) && isalpha((unsigned char)part[2])) {
+            country[0] = toupper((unsigned char)raw[1]);
+            country[1] = toupper((unsigned char)raw[2]);
+        } else if (part.size() == 2 && language[0] != 0 && country[0] == 0
+                && isalpha((unsigned char)part[0]) && isalpha((unsigned char)part[1])) {
+            // toString() 输出的是 "en-US" 这种不带 r 的形式, 也一起支持
+            country[0] = toupper((unsigned char)raw[0]);
+            country[1] = toupper((unsigned char)raw[1]);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ResTable_config::match(const ResTable_config& settings) const {
+    if (imsi != 0) {
+        if (mcc != 0 && mcc != settings.mcc) {
+            return false;
+        }
+        if (mnc != 0 && mnc != settings.mnc) {
+            return false;
+        }
+    }
+    if (locale != 0) {
+        if (language[0] != 0
+            && (language[0] != settings.language[0]
+                || language[1] != settings.language[1])) {
+            return false;
+        }
+        if (country[0] != 0
+            && (country[0] != settings.country[0]
+                || country[1] != settings.country[1])) {
+            return false;
+        }
+    }
+    if (screenConfig != 0) {
+        const int layoutDir = screenLayout&MASK_LAYOUTDIR;
+        const int setLayoutDir = settings.screenLayout&MASK_LAYOUTDIR;
+        if (layoutDir != 0 && layoutDir != setLayoutDir) {
+            return false;
+        }
+
+        const int screenSize = screenLayout&MASK_SCREENSIZE;
+        const int setScreenSize = settings.screenLayout&MASK_SCREENSIZE;
+        // Any screen sizes for larger screens than the setting do not
+        // match.
+        if (screenSize != 0 && screenSize > setScreenSize) {
+            return false;
+        }
+
+        const int screenLong = screenLayout&MASK_SCREENLONG;
+        const int setScreenLong = settings.screenLayout&MASK_SCREENLONG;
+        if (screenLong != 0 && screenLong != setScreenLong) {
+            return false;
+        }
+
+        const int uiModeType = uiMode&MASK_UI_MODE_TYPE;
+        const int setUiModeType = settings.uiMode&MASK_UI_MODE_TYPE;
+        if (uiModeType != 0 && uiModeType != setUiModeType) {
+            return false;
+        }
+
+        const int uiModeNight = uiMode&MASK_UI_MODE_NIGHT;
+        const int setUiModeNight = settings.uiMode&MASK_UI_MODE_NIGHT;
+        if (uiModeNight != 0 && uiModeNight != setUiModeNight) {
+            return false;
+        }
+
+        if (smallestScreenWidthDp != 0
+                && smallestScreenWidthDp > settings.smallestScreenWidthDp) {
+            return false;
+        }
+    }
+    if (screenSizeDp != 0) {
+        if (screenWidthDp != 0 && screenWidthDp > settings.screenWidthDp) {
+            return false;
+        }
+        if (screenHeightDp != 0 && screenHeightDp > settings.screenHeightDp) {
+            return false;
+        }
+    }
+    if (screenType != 0) {
+        if (orientation != 0 && orientation != settings.orientation) {
+            return false;
+        }
+        // density always matches - we can scale it.  See isBetterThan
+        if (touchscreen != 0 && touchscreen != settings.touchscreen) {
+            return false;
+        }
+    }
+    if (input != 0) {
+        const int keysHidden = inputFlags&MASK_KEYSHIDDEN;
+        const int setKeysHidden = settings.inputFlags&MASK_KEYSHIDDEN;
+        if (keysHidden != 0 && keysHidden != setKeysHidden) {
+            // For compatibility, we count a request for KEYSHIDDEN_NO as also
+            // matching the more recent KEYSHIDDEN_SOFT.  Basically
+            // KEYSHIDDEN_NO means there is some kind of keyboard available.
+            if (keysHidden != KEYSHIDDEN_NO || setKeysHidden != KEYSHIDDEN_SOFT) {
+                return false;
+            }
+        }
+        const int navHidden = inputFlags&MASK_NAVHIDDEN;
+        const int setNavHidden = settings.inputFlags&MASK_NAVHIDDEN;
+        if (navHidden != 0 && navHidden != setNavHidden) {
+            return false;
+        }
+        if (keyboard != 0 && keyboard != settings.keyboard) {
+            return false;
+        }
+        if (navigation != 0 && navigation != settings.navigation) {
+            return false;
+        }
+    }
+    if (screenSize != 0) {
+        if (screenWidth != 0 && screenWidth > settings.screenWidth) {
+            return false;
+        }
+        if (screenHeight != 0 && screenHeight > settings.screenHeight) {
+            return false;
+        }
+    }
+    if (version != 0) {
+        if (sdkVersion != 0 && sdkVersion > settings.sdkVersion) {
+            return false;
+        }
+        if (minorVersion != 0 && minorVersion != settings.minorVersion) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ResTable_config::isBetterThan(const ResTable_config& o,
+        const ResTable_config& requested) const {
+    if (imsi || o.imsi) {
+        if ((mcc != o.mcc) && requested.mcc) {
+            return (mcc);
+        }
+
+        if ((mnc != o.mnc) && requested.mnc) {
+            return (mnc);
+        }
+    }
+
+    if (locale || o.locale) {
+        if ((language[0] != o.language[0]) && requested.language[0]) {
+            return (language[0]);
+        }
+
+        if ((country[0] != o.country[0]) && requested.country[0]) {
+            return (country[0]);
+        }
+    }
+
+    if (screenLayout || o.screenLayout) {
+        if (((screenLayout^o.screenLayout) & MASK_LAYOUTDIR) != 0
+                && (requested.screenLayout & MASK_LAYOUTDIR)) {
+            int myLayoutDir = screenLayout & MASK_LAYOUTDIR;
+            int oLayoutDir = o.screenLayout & MASK_LAYOUTDIR;
+            return (myLayoutDir > oLayoutDir);
+        }
+    }
+
+    if (smallestScreenWidthDp || o.smallestScreenWidthDp) {
+        // The configuration closest to the actual size is best.
+        // We assume that larger configs have already been filtered
+        // out at this point.  That means we just want the largest one.
+        if (smallestScreenWidthDp != o.smallestScreenWidthDp) {
+            return smallestScreenWidthDp > o.smallestScreenWidthDp;
+        }
+    }
+
+    if (screenSizeDp || o.screenSizeDp) {
+        // "Better" is based on the sum of the difference between both
+        // width and height from the requested dimensions.  We are
+        // assuming the invalid configs (with smaller dimens) have
+        // already been filtered.  Note that if a particular dimension
+        // is unspecified, we will end up with a large value (the
+        // difference between 0 and the requested dimension), which is
+        // good since we will prefer a config that has specified a
+        // dimension value.
+        int myDelta = 0, otherDelta = 0;
+        if (requested.screenWidthDp) {
+            myDelta += requested.screenWidthDp - screenWidthDp;
+            otherDelta += requested.screenWidthDp - o.screenWidthDp;
+        }
+        if (requested.screenHeightDp) {
+            myDelta += requested.screenHeightDp - screenHeightDp;
+            otherDelta += requested.screenHeightDp - o.screenHeightDp;
+        }
+        if (myDelta != otherDelta) {
+            return myDelta < otherDelta;
+        }
+    }
+
+    if (screenLayout || o.screenLayout) {
+        if (((screenLayout^o.screenLayout) & MASK_SCREENSIZE) != 0
+                && (requested.screenLayout & MASK_SCREENSIZE)) {
+            // A little backwards compatibility here: undefined is
+            // considered equivalent to normal.  But only if the
+            // requested size is at least normal; otherwise, small
+            // is better than the default.
+            int mySL = (screenLayout & MASK_SCREENSIZE);
+            int oSL = (o.screenLayout & MASK_SCREENSIZE);
+            int fixedMySL = mySL;
+            int fixedOSL = oSL;
+            if ((requested.screenLayout & MASK_SCREENSIZE) >= SCREENSIZE_NORMAL) {
+                if (fixedMySL == 0) fixedMySL = SCREENSIZE_NORMAL;
+                if (fixedOSL == 0) fixedOSL = SCREENSIZE_NORMAL;
+            }
+            // For screen size, the best match is the one that is
+            // closest to the requested screen size, but not over
+            // (the not over part is dealt with in match() below).
+            if (fixedMySL == fixedOSL) {
+                // If the two are the same, but 'this' is actually
+                // undefined, then the other is really a better match.
+                if (mySL == 0) return false;
+                return true;
+            }
+            if (fixedMySL != fixedOSL) {
+                return fixedMySL > fixedOSL;
+            }
+        }
+        if (((screenLayout^o.screenLayout) & MASK_SCREENLONG) != 0
+                && (requested.screenLayout & MASK_SCREENLONG)) {
+            return (screenLayout & MASK_SCREENLONG);
+        }
+    }
+
+    if ((orientation != o.orientation) && requested.orientation) {
+        return (orientation);
+    }
+
+    if (uiMode || o.uiMode) {
+        if (((uiMode^o.uiMode) & MASK_UI_MODE_TYPE) != 0
+                && (requested.uiMode & MASK_UI_MODE_TYPE)) {
+            return (uiMode & MASK_UI_MODE_TYPE);
+        }
+        if (((uiMode^o.uiMode) & MASK_UI_MODE_NIGHT) != 0
+                && (requested.uiMode & MASK_UI_MODE_NIGHT)) {
+            return (uiMode & MASK_UI_MODE_NIGHT);
+        }
+    }
+
+    if (screenType || o.screenType) {
+        if (density != o.density) {
+            // Use the system default density (DENSITY_MEDIUM, 160dpi) if none specified.
+            const int thisDensity = density ? density : int(DENSITY_MEDIUM);
+            const int otherDensity = o.density ? o.density : int(DENSITY_MEDIUM);
+
+            int requestedDensity = requested.density;
+            if (requestedDensity == 0) {
+                requestedDensity = DENSITY_MEDIUM;
+            }
+
+            // Any density is potentially useful
+            // because the system will scale it.  Always prefer
+            // scaling down.
+            int h = thisDensity;
+            int l = otherDensity;
+            bool bImBigger = true;
+            if (l > h) {
+                int t = h;
+                h = l;
+                l = t;
+                bImBigger = false;
+            }
+
+            if (requestedDensity >= h) {
+                // requested value higher than both l and h, give h
+                return bImBigger;
+            }
+            if (l >= requestedDensity) {
+                // requested value lower than both l and h, give l
+                return !bImBigger;
+            }
+            // saying that scaling down is 2x better than up
+            if (((2 * l) - requestedDensity) * h > requestedDensity * requestedDensity) {
+                return !bImBigger;
+            } else {
+                return bImBigger;
+            }
+        }
+
+        if ((touchscreen != o.touchscreen) && requested.touchscreen) {
+            return (touchscreen);
+        }
+    }
+
+    if (input || o.input) {
+        const int keysHidden = inputFlags & MASK_KEYSHIDDEN;
+        const int oKeysHidden = o.inputFlags & MASK_KEYSHIDDEN;
+        if (keysHidden != oKeysHidden) {
+            const int reqKeysHidden =
+                    requested.inputFlags & MASK_KEYSHIDDEN;
+            if (reqKeysHidden) {
+
+                if (!keysHidden) return false;
+                if (!oKeysHidden) return true;
+                // For compatibility, we count KEYSHIDDEN_NO as being
+                // the same as KEYSHIDDEN_SOFT.  Here we disambiguate
+                // these by making an exact match more specific.
+                if (reqKeysHidden == keysHidden) return true;
+                if (reqKeysHidden == oKeysHidden) return false;
+            }
+        }
+
+        const int navHidden = inputFlags & MASK_NAVHIDDEN;
+        const int oNavHidden = o.inputFlags & MASK_NAVHIDDEN;
+        if (navHidden != oNavHidden) {
+            const int reqNavHidden =
+                    requested.inputFlags & MASK_NAVHIDDEN;
+            if (reqNavHidden) {
+
+                if (!navHidden) return false;
+                if (!oNavHidden) return true;
+            }
+        }
+
+        if ((keyboard != o.keyboard) && requested.keyboard) {
+            return (keyboard);
+        }
+
+        if ((navigation != o.navigation) && requested.navigation) {
+            return (navigation);
+        }
+    }
+
+    if (screenSize || o.screenSize) {
+        // "Better" is based on the sum of the difference between both
+        // width and height from the requested dimensions.  We are
+        // assuming the invalid configs (with smaller sizes) have
+        // already been filtered.  Note that if a particular dimension
+        // is unspecified, we will end up with a large value (the
+        // difference between 0 and the requested dimension), which is
+        // good since we will prefer a config that has specified a
+        // size value.
+        int myDelta = 0, otherDelta = 0;
+        if (requested.screenWidth) {
+            myDelta += requested.screenWidth - screenWidth;
+            otherDelta += requested.screenWidth - o.screenWidth;
+        }
+        if (requested.screenHeight) {
+            myDelta += requested.screenHeight - screenHeight;
+            otherDelta += requested.screenHeight - o.screenHeight;
+        }
+        if (myDelta != otherDelta) {
+            return myDelta < otherDelta;
+        }
+    }
+
+    if (version || o.version) {
+        if ((sdkVersion != o.sdkVersion) && requested.sdkVersion) {
+            return (sdkVersion > o.sdkVersion);
+        }
+
+        if ((minorVersion != o.minorVersion) &&
+                requested.minorVersion) {
+            return (minorVersion);
+        }
+    }
+
+    return false;
+}
@@ -436,6 +436,15 @@ struct ResTable_config
     };
 
 	std::string toString() const;
+
+	// 解析 "en-rUS-sw600dp-xhdpi-v28" 这样的限定符字符串, 空字符串和 "default" 表示默认配置.
+	// 有不认识的限定符时返回 false
+	bool fromString(const std::string& qualifiers);
+
+	// 规则和 frameworks/base/libs/androidfw 里的一致, 只是去掉了这个结构体里没有的字段
+	bool match(const ResTable_config& settings) const;
+
+	bool isBetterThan(const ResTable_config& o, const ResTable_config& requested) const;
 };
     
 
@@ -452,10 +461,21 @@ struct ResTable_type
     // resource identifier).  0 is invalid.
     uint8_t id;
     
+    enum {
+        // If set, the entry is sparse, and encodes both the entry ID and offset into each entry,
+        // and a binary search is used to find the key. Only available on platforms >= O.
+        // Mark any types that use this with a v26 qualifier to prevent runtime issues on older
+        // platforms.
+        FLAG_SPARSE = 0x01,
+
+        // If set, the offsets to the entries are encoded in 16-bit, real_offset = offset * 4u
+        // An 16-bit offset of 0xffffu means a NO_ENTRY
+        FLAG_OFFSET16 = 0x02,
+    };
+    uint8_t flags;
+
     // Must be 0.
-    uint8_t res0;
-    // Must be 0.
-    uint16_t res1;
+    uint16_t reserved;
     
     // Number of uint32_t entry indices that follow.
     uint32_t entryCount;
@@ -466,6 +486,21 @@ struct ResTable_type
 	ResTable_config config;
 };
 
+/**
+ * An entry in a ResTable_type with the flag `FLAG_SPARSE` set.
+ */
+union ResTable_sparseTypeEntry {
+    // Holds the raw uint32_t encoded value. Do not read this.
+    uint32_t entry;
+    struct {
+        // The index of the entry.
+        uint16_t idx;
+
+        // The offset from ResTable_type::entriesStart, divided by 4.
+        uint16_t offset;
+    };
+};
+
 /**
  * Reference to a string in a string pool.
  */
@@ -477,6 +512,25 @@ struct ResStringPool_ref
     uint32_t index;
 };
 
+/**
+ * This structure defines a span of style information associated with
+ * a string in the pool.
+ */
+struct ResStringPool_span
+{
+    enum {
+        END = 0xFFFFFFFF
+    };
+
+    // This is the name of the span -- that is, the name of the XML
+    // tag that defined it.  The special value END (0xFFFFFFFF) indicates
+    // the end of an array of spans.
+    ResStringPool_ref name;
+
+    // The range of characters in the string that this span applies to.
+    uint32_t firstChar, lastChar;
+};
+
 
 /**
  * This is the beginning of information about an entry in the resource
@@ -0,0 +1,171 @@
+#include "ResourcesFile.h"
+
+#include <iostream>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+ResourcesFilePtr ResourcesFile::open(const string& filePath, LoadMode mode) {
+	int fd = ::open(filePath.c_str(), O_RDONLY);
+	if(fd < 0) {
+		cout<<"[ResourcesFile] open failed: "<<filePath<<endl;
+		return nullptr;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		::close(fd);
+		return nullptr;
+	}
+
+	ResourcesFilePtr pFile(new ResourcesFile());
+	pFile->mFd = fd;
+	pFile->mSize = st.st_size;
+	pFile->mMode = mode;
+	pFile->mStat = st;
+
+	if(mode == LOAD_MMAP && pFile->mSize > 0) {
+		// MAP_PRIVATE + PROT_WRITE: 真有人写也只是写时复制到私有页
+		void* pAddr = mmap(nullptr, pFile->mSize, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if(pAddr == MAP_FAILED) {
+			cout<<"[ResourcesFile] mmap failed, fallback to stream"<<endl;
+			pFile->mMode = LOAD_STREAM;
+		} else {
+			pFile->mData = (byte*)pAddr;
+		}
+	}
+	return pFile;
+}
+
+ResourcesFile::~ResourcesFile() {
+	if(mData != nullptr) {
+		munmap(mData, mSize);
+		mData = nullptr;
+	}
+	if(mFd >= 0) {
+		::close(mFd);
+		mFd = -1;
+	}
+}
+
+bool ResourcesFile::read(uint32_t offset, void* pBuf, uint32_t len) const {
+	if((uint64_t)offset + len > mSize) {
+		return false;
+	}
+	if(mData != nullptr) {
+		memcpy(pBuf, mData + offset, len);
+		return true;
+	}
+	uint32_t done = 0;
+	while(done < len) {
+		ssize_t n = pread(mFd, (byte*)pBuf + done, len - done, offset + done);
+		if(n <= 0) {
+			return false;
+		}
+		done += n;
+	}
+	return true;
+}
+
+bool ResourcesFile::copyTo(int destFd, uint32_t offset, uint32_t len, uint32_t destOffset) const {
+	if((uint64_t)offset + len > mSize) {
+		return false;
+	}
+	uint32_t done = 0;
+#ifdef __linux__
+	// 不经过用户态缓冲区, 有的文件系统上还能直接共享数据块.
+	// 内核或者文件系统不支持(ENOSYS/EXDEV/EINVAL 等)时从已经拷贝完的位置接着往下走
+	loff_t srcOffset = offset;
+	loff_t destPos = destOffset;
+	while(done < len) {
+		ssize_t n = copy_file_range(mFd, &srcOffset, destFd, &destPos, len - done, 0);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			break;
+		}
+		done += n;
+	}
+#endif
+
+	// 映射模式直接从映射内存写, 其他模式一块一块地读出来再写
+	const uint32_t BLOCK_SIZE = 1 << 20;
+	unique_ptr<byte[]> pBlock(mData == nullptr && done < len ? new byte[min(len - done, BLOCK_SIZE)] : nullptr);
+	while(done < len) {
+		const uint32_t blockSize = mData != nullptr ? len - done : min(len - done, BLOCK_SIZE);
+		const byte* pSrc = mData != nullptr ? mData + offset + done : pBlock.get();
+		if(mData == nullptr && !read(offset + done, pBlock.get(), blockSize)) {
+			return false;
+		}
+		uint32_t written = 0;
+		while(written < blockSize) {
+			ssize_t n = pwrite(destFd, pSrc + written, blockSize - written, destOffset + done + written);
+			if(n <= 0) {
+				return false;
+			}
+			written += n;
+		}
+		done += blockSize;
+	}
+	return true;
+}
+
+bool ResourcesFile::isSameFile(const string& path) const {
+	struct stat self;
+	struct stat other;
+	return fstat(mFd, &self) == 0
+		&& stat(path.c_str(), &other) == 0
+		&& self.st_dev == other.st_dev
+		&& self.st_ino == other.st_ino;
+}
+
+shared_ptr<ResourcesFile::byte> ResourcesFile::view(uint32_t offset, uint32_t len) {
+	if((uint64_t)offset + len > mSize) {
+		return nullptr;
+	}
+	if(mData != nullptr) {
+		// aliasing 构造: 指向映射内部, 引用计数记在整个文件上
+		return shared_ptr<byte>(shared_from_this(), mData + offset);
+	}
+	shared_ptr<byte> pData = shared_ptr<byte>(
+			new byte[len],
+			default_delete<byte[]>()
+	);
+	if(!read(offset, pData.get(), len)) {
+		return nullptr;
+	}
+	return pData;
+}
+
+void ResourcesFile::advise(Advice advice, uint32_t offset, uint32_t len) {
+	if(mData == nullptr) {
+		return;
+	}
+	if(len == 0 || (uint64_t)offset + len > mSize) {
+		len = mSize - offset;
+	}
+	// madvise 要求起始地址按页对齐
+	const uint32_t pageSize = sysconf(_SC_PAGESIZE);
+	const uint32_t alignOffset = offset - offset % pageSize;
+	len += offset - alignOffset;
+
+	int flag = MADV_NORMAL;
+	switch(advice) {
+		case ADVICE_SEQUENTIAL:
+			flag = MADV_SEQUENTIAL;
+			break;
+		case ADVICE_RANDOM:
+			flag = MADV_RANDOM;
+			break;
+		default:
+			break;
+	}
+	madvise(mData + alignOffset, len, flag);
+}
@@ -0,0 +1,125 @@
+#ifndef RESOURCES_FILE_H
+#define RESOURCES_FILE_H
+
+#include <string>
+#include <memory>
+#include <ios>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/**
+ * resources.arsc 的数据源.
+ *
+ * LOAD_STREAM: 和以前一样, 每个 chunk 都拷贝一份到新分配的内存里.
+ * LOAD_MMAP:   整个文件 mmap 进来, view() 返回的是映射内存里的视图, 不拷贝.
+ *              映射是 MAP_PRIVATE 的, 修改只会落在进程私有页上, 不会改到源文件.
+ */
+class ResourcesFile : public std::enable_shared_from_this<ResourcesFile> {
+public:
+	typedef unsigned char byte;
+
+	enum LoadMode {
+		LOAD_STREAM,
+		LOAD_MMAP
+	};
+
+	enum Advice {
+		ADVICE_NORMAL,
+		ADVICE_SEQUENTIAL,
+		ADVICE_RANDOM
+	};
+
+	// 打开失败返回 nullptr
+	static std::shared_ptr<ResourcesFile> open(const std::string& filePath, LoadMode mode);
+
+	~ResourcesFile();
+
+	LoadMode getLoadMode() const {
+		return mMode;
+	}
+
+	uint32_t size() const {
+		return mSize;
+	}
+
+	// 映射模式下返回映射的起始地址, 其他模式返回 nullptr
+	const byte* data() const {
+		return mData;
+	}
+
+	// 拷贝 [offset, offset+len) 到 pBuf, 越界返回 false
+	bool read(uint32_t offset, void* pBuf, uint32_t len) const;
+
+	// 把 [offset, offset+len) 写到 destFd 的 destOffset 处, 不改变 destFd 的文件指针.
+	// Linux 上先用 copy_file_range 在内核里拷贝, 不支持的话退回普通的读写
+	bool copyTo(int destFd, uint32_t offset, uint32_t len, uint32_t destOffset) const;
+
+	// path 和打开的是不是同一个文件
+	bool isSameFile(const std::string& path) const;
+
+	// 打开时, 还没有读任何数据之前 fstat 的结果
+	const struct stat& getStat() const {
+		return mStat;
+	}
+
+	// 映射模式下是映射内存的视图(持有整个映射的引用), 其他模式下拷贝一份
+	std::shared_ptr<byte> view(uint32_t offset, uint32_t len);
+
+	// 只对映射模式生效
+	void advise(Advice advice, uint32_t offset = 0, uint32_t len = 0);
+
+private:
+	ResourcesFile() : mMode(LOAD_STREAM), mFd(-1), mSize(0), mData(nullptr), mStat() {  }
+
+	LoadMode mMode;
+	int mFd;
+	uint32_t mSize;
+	byte* mData;
+	struct stat mStat;
+};
+typedef std::shared_ptr<ResourcesFile> ResourcesFilePtr;
+
+/**
+ * ResourcesFile 上的读指针, 接口和之前用的 std::ifstream 保持一致.
+ */
+class ResourcesStream {
+public:
+	typedef ResourcesFile::byte byte;
+
+	ResourcesStream(ResourcesFilePtr pFile, uint32_t pos = 0) : mFile(pFile), mPos(pos) {  }
+
+	bool read(char* pBuf, uint32_t len) {
+		if(!mFile->read(mPos, pBuf, len)) {
+			return false;
+		}
+		mPos += len;
+		return true;
+	}
+
+	// 读取 len 个字节, 映射模式下不拷贝
+	std::shared_ptr<byte> view(uint32_t len) {
+		std::shared_ptr<byte> pData = mFile->view(mPos, len);
+		if(pData != nullptr) {
+			mPos += len;
+		}
+		return pData;
+	}
+
+	void seekg(int64_t off, std::ios::seekdir dir = std::ios::beg) {
+		mPos = (dir == std::ios::cur ? mPos : 0) + off;
+	}
+
+	uint32_t tellg() const {
+		return mPos;
+	}
+
+	ResourcesFilePtr file() const {
+		return mFile;
+	}
+
+private:
+	ResourcesFilePtr mFile;
+	uint32_t mPos;
+};
+
+#endif  /*RESOURCES_FILE_H*/
@@ -0,0 +1,442 @@
+#include "ResourcesIndex.h"
+#include "StringTranscoder.h"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+typedef ResourcesParser::byte byte;
+
+// 下面的结构体按原样写进文件, 所有 xxxOffset 都是相对 .rpidx 文件开头的偏移,
+// 只有 ChunkRecord/PackageRecord 里的源文件位置是相对 resources.arsc 的
+struct StrIdxRecord {
+	uint32_t slotsOffset;
+	uint32_t capacity;
+	uint32_t count;
+};
+
+struct IndexHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceSize;
+	int64_t sourceMtimeSec;
+	int64_t sourceMtimeNsec;
+	uint64_t sourceHash;
+	uint32_t globalPoolOffset;
+	uint32_t packageCount;
+	uint32_t packagesOffset;
+	StrIdxRecord globalStrIdx;
+};
+
+struct PackageRecord {
+	uint32_t packageId;
+	uint32_t packageOffset;
+	uint32_t typesPoolOffset;
+	uint32_t keysPoolOffset;
+	uint32_t chunkCount;
+	uint32_t chunksOffset;
+	uint32_t typeCount;
+	uint32_t typesOffset;
+	StrIdxRecord typesStrIdx;
+	StrIdxRecord keysStrIdx;
+};
+
+struct ChunkRecord {
+	uint16_t type;
+	uint16_t reserved;
+	uint32_t offset;
+	uint32_t size;
+	// 只对 RES_TABLE_TYPE_TYPE 有效
+	ResTable_type header;
+};
+
+struct TypeRecord {
+	uint32_t typeId;
+	uint32_t entryCount;
+	uint32_t configCount;
+	uint32_t configWords;
+	uint32_t firstConfigsOffset;
+	uint32_t keyIndicesOffset;
+	uint32_t configBitsOffset;
+	uint32_t keyEntryCount;
+	uint32_t keyEntriesOffset;
+};
+
+static const char INDEX_MAGIC[4] = { 'R', 'P', 'I', 'X' };
+
+static bool statSource(const string& path, uint64_t& size, int64_t& mtimeSec, int64_t& mtimeNsec) {
+	struct stat st;
+	if(stat(path.c_str(), &st) != 0) {
+		return false;
+	}
+	size = st.st_size;
+#ifdef __APPLE__
+	mtimeSec = st.st_mtimespec.tv_sec;
+	mtimeNsec = st.st_mtimespec.tv_nsec;
+#else
+	mtimeSec = st.st_mtim.tv_sec;
+	mtimeNsec = st.st_mtim.tv_nsec;
+#endif
+	return true;
+}
+
+// FNV-1a 64, 整个文件
+static uint64_t hashSource(ResourcesFilePtr pSource) {
+	uint64_t hash = 14695981039346656037ull;
+	vector<byte> buf(64 * 1024);
+	for(uint32_t offset = 0 ; offset < pSource->size() ; offset += buf.size()) {
+		uint32_t len = min((uint32_t)buf.size(), pSource->size() - offset);
+		const byte* pData = pSource->data() != nullptr ? pSource->data() + offset : buf.data();
+		if(pSource->data() == nullptr && !pSource->read(offset, buf.data(), len)) {
+			return 0;
+		}
+		for(uint32_t i = 0 ; i < len ; i++) {
+			hash ^= pData[i];
+			hash *= 1099511628211ull;
+		}
+	}
+	return hash;
+}
+
+// 追加到 buf 末尾并按 8 字节对齐, 返回起始偏移
+static uint32_t appendData(vector<byte>& buf, const void* pData, size_t size) {
+	uint32_t offset = buf.size();
+	buf.insert(buf.end(), (const byte*)pData, (const byte*)pData + size);
+	buf.resize((buf.size() + 7) & ~(size_t)7, 0);
+	return offset;
+}
+
+static StrIdxRecord appendStrIdx(vector<byte>& buf, ResourcesParser::ResStringPoolPtr pPool) {
+	StrIdxRecord record = { 0, 0, 0 };
+	if(pPool == nullptr || pPool->header.stringCount == 0) {
+		return record;
+	}
+	if(pPool->strIdxTable.empty()) {
+		pPool->buildStrIdxTable();
+	}
+	record.capacity = pPool->strIdxTable.size();
+	record.count = pPool->strIdxCount;
+	record.slotsOffset = appendData(buf, pPool->strIdxTable.data(), record.capacity * sizeof(uint32_t));
+	return record;
+}
+
+bool ResourcesIndex::write(const string& indexPath, const string& sourcePath, ResourcesParser& parser) {
+	if(parser.mFile == nullptr || parser.mGlobalStringPool == nullptr) {
+		return false;
+	}
+
+	// 先占好文件头和 package 记录的位置, 最后再填
+	vector<byte> buf(sizeof(IndexHeader), 0);
+	IndexHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	header.version = VERSION;
+	if(!statSource(sourcePath, header.sourceSize, header.sourceMtimeSec, header.sourceMtimeNsec)
+			|| header.sourceSize != parser.mFile->size()) {
+		return false;
+	}
+	header.sourceHash = hashSource(parser.mFile);
+	header.globalPoolOffset = sizeof(ResTable_header);
+	header.packageCount = parser.mResourceForId.size();
+	header.globalStrIdx = appendStrIdx(buf, parser.mGlobalStringPool);
+
+	vector<PackageRecord> packages;
+	for(auto& item : parser.mResourceForId) {
+		ResourcesParser::PackageResourcePtr pPackage = item.second;
+		PackageRecord record;
+		memset(&record, 0, sizeof(record));
+		record.packageId = item.first;
+		record.packageOffset = pPackage->chunkOffset;
+		// 和 parserPackageResource 一样, 两个字符串池紧跟在 ResTable_package 后面
+		record.typesPoolOffset = pPackage->chunkOffset + sizeof(ResTable_package);
+		record.keysPoolOffset = record.typesPoolOffset + pPackage->pTypes->header.header.size;
+
+		vector<ChunkRecord> chunks;
+		for(const ResourcesParser::ChunkInfo& chunk : pPackage->chunks) {
+			ChunkRecord chunkRecord;
+			memset(&chunkRecord, 0, sizeof(chunkRecord));
+			chunkRecord.type = chunk.type;
+			chunkRecord.offset = chunk.offset;
+			chunkRecord.size = chunk.size;
+			if(chunk.pResTableType != nullptr) {
+				chunkRecord.header = chunk.pResTableType->header;
+			}
+			chunks.push_back(chunkRecord);
+		}
+		record.chunkCount = chunks.size();
+		record.chunksOffset = appendData(buf, chunks.data(), chunks.size() * sizeof(ChunkRecord));
+
+		vector<TypeRecord> types;
+		for(auto& typeItem : pPackage->resTablePtrs) {
+			const ResourcesParser::TypeIndex* pIndex =
+				parser.getTypeIndexForId((item.first << 24) | (typeItem.first << 16));
+			if(pIndex == nullptr) {
+				continue;
+			}
+			TypeRecord typeRecord;
+			typeRecord.typeId = typeItem.first;
+			typeRecord.entryCount = pIndex->entryCount;
+			typeRecord.configCount = typeItem.second.size();
+			typeRecord.configWords = pIndex->configWords;
+			typeRecord.firstConfigsOffset = appendData(
+					buf, pIndex->firstConfigs.data(), pIndex->entryCount * sizeof(uint16_t));
+			typeRecord.keyIndicesOffset = appendData(
+					buf, pIndex->keyIndices.data(), pIndex->entryCount * sizeof(uint32_t));
+			typeRecord.configBitsOffset = appendData(
+					buf, pIndex->configBits.data(), pIndex->configBits.size() * sizeof(uint64_t));
+			// 哈希表的遍历顺序不固定, 按 key 排好序再存, 同样的表写出同样的文件
+			vector<pair<uint32_t, uint32_t> > sortedKeyEntries(pIndex->keyEntries.begin(), pIndex->keyEntries.end());
+			sort(sortedKeyEntries.begin(), sortedKeyEntries.end());
+			vector<uint32_t> keyEntries;
+			for(auto& keyEntry : sortedKeyEntries) {
+				keyEntries.push_back(keyEntry.first);
+				keyEntries.push_back(keyEntry.second);
+			}
+			typeRecord.keyEntryCount = pIndex->keyEntries.size();
+			typeRecord.keyEntriesOffset = appendData(buf, keyEntries.data(), keyEntries.size() * sizeof(uint32_t));
+			types.push_back(typeRecord);
+		}
+		record.typeCount = types.size();
+		record.typesOffset = appendData(buf, types.data(), types.size() * sizeof(TypeRecord));
+
+		record.typesStrIdx = appendStrIdx(buf, pPackage->pTypes);
+		record.keysStrIdx = appendStrIdx(buf, pPackage->pKeys);
+		packages.push_back(record);
+	}
+	header.packagesOffset = appendData(buf, packages.data(), packages.size() * sizeof(PackageRecord));
+	memcpy(buf.data(), &header, sizeof(header));
+
+	// 先写临时文件再改名, 其他进程不会读到写了一半的索引
+	string tmpPath = indexPath + ".tmp";
+	FILE* pFile = fopen(tmpPath.c_str(), "wb");
+	if(pFile == nullptr) {
+		return false;
+	}
+	bool isWritten = fwrite(buf.data(), 1, buf.size(), pFile) == buf.size();
+	isWritten = (fclose(pFile) == 0) && isWritten;
+	if(!isWritten || rename(tmpPath.c_str(), indexPath.c_str()) != 0) {
+		unlink(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+ResourcesIndexPtr ResourcesIndex::open(const string& indexPath, const string& sourcePath, ResourcesFilePtr pSource) {
+	// 没有索引文件是正常情况, 不让 ResourcesFile 输出打开失败
+	if(pSource == nullptr || access(indexPath.c_str(), R_OK) != 0) {
+		return nullptr;
+	}
+	ResourcesFilePtr pFile = ResourcesFile::open(indexPath, ResourcesFile::LOAD_MMAP);
+	if(pFile == nullptr || pFile->data() == nullptr || pFile->size() < sizeof(IndexHeader)) {
+		return nullptr;
+	}
+	IndexHeader header;
+	memcpy(&header, pFile->data(), sizeof(header));
+	if(memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || header.version != VERSION) {
+		return nullptr;
+	}
+
+	uint64_t size = 0;
+	int64_t mtimeSec = 0;
+	int64_t mtimeNsec = 0;
+	if(!statSource(sourcePath, size, mtimeSec, mtimeNsec)
+			|| size != header.sourceSize
+			|| size != pSource->size()) {
+		return nullptr;
+	}
+	if(mtimeSec != header.sourceMtimeSec || mtimeNsec != header.sourceMtimeNsec) {
+		if(hashSource(pSource) != header.sourceHash) {
+			return nullptr;
+		}
+		// 内容没变, 更新 mtime 省得下次再算哈希. 写失败也不影响这次使用
+		int fd = ::open(indexPath.c_str(), O_WRONLY);
+		if(fd >= 0) {
+			header.sourceMtimeSec = mtimeSec;
+			header.sourceMtimeNsec = mtimeNsec;
+			if(pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+				cout <<"[ResourcesIndex] can't update " <<indexPath <<endl;
+			}
+			::close(fd);
+		}
+	}
+
+	ResourcesIndexPtr pIndex(new ResourcesIndex(pFile));
+	if(!pIndex->isValid(pSource->size())) {
+		return nullptr;
+	}
+	return pIndex;
+}
+
+// [offset, offset + count * elemSize) 在 size 以内
+static bool inBounds(uint64_t size, uint32_t offset, uint64_t count, uint64_t elemSize) {
+	return offset + count * elemSize <= size;
+}
+
+static bool isStrIdxValid(const StrIdxRecord& record, uint64_t size) {
+	// 容量为 0 表示没有保存, 否则必须是 2 的幂
+	return (record.capacity & (record.capacity - 1)) == 0
+		&& inBounds(size, record.slotsOffset, record.capacity, sizeof(uint32_t));
+}
+
+bool ResourcesIndex::isValid(uint32_t sourceSize) const {
+	// 只检查偏移都没有越界, 内容是否和源文件对应靠文件头里的 key 保证
+	const uint64_t size = mFile->size();
+	const byte* pData = mFile->data();
+	const IndexHeader* pHeader = (const IndexHeader*)pData;
+	if(!inBounds(size, pHeader->packagesOffset, pHeader->packageCount, sizeof(PackageRecord))
+			|| !isStrIdxValid(pHeader->globalStrIdx, size)) {
+		return false;
+	}
+	const PackageRecord* pPackages = (const PackageRecord*)(pData + pHeader->packagesOffset);
+	for(uint32_t i = 0 ; i < pHeader->packageCount ; i++) {
+		const PackageRecord& package = pPackages[i];
+		if(!inBounds(size, package.chunksOffset, package.chunkCount, sizeof(ChunkRecord))
+				|| !inBounds(size, package.typesOffset, package.typeCount, sizeof(TypeRecord))
+				|| !isStrIdxValid(package.typesStrIdx, size)
+				|| !isStrIdxValid(package.keysStrIdx, size)) {
+			return false;
+		}
+		const ChunkRecord* pChunks = (const ChunkRecord*)(pData + package.chunksOffset);
+		for(uint32_t j = 0 ; j < package.chunkCount ; j++) {
+			if(!inBounds(sourceSize, pChunks[j].offset, pChunks[j].size, 1)) {
+				return false;
+			}
+		}
+		const TypeRecord* pTypes = (const TypeRecord*)(pData + package.typesOffset);
+		for(uint32_t j = 0 ; j < package.typeCount ; j++) {
+			const TypeRecord& type = pTypes[j];
+			if(!inBounds(size, type.firstConfigsOffset, type.entryCount, sizeof(uint16_t))
+					|| !inBounds(size, type.keyIndicesOffset, type.entryCount, sizeof(uint32_t))
+					|| !inBounds(size, type.configBitsOffset, (uint64_t)type.entryCount * type.configWords, sizeof(uint64_t))
+					|| !inBounds(size, type.keyEntriesOffset, type.keyEntryCount, 2 * sizeof(uint32_t))
+					|| type.configWords != (type.configCount + 63) / 64) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static void restoreStrIdx(const byte* pData, const StrIdxRecord& record, ResourcesParser::ResStringPoolPtr pPool) {
+	if(pPool == nullptr || record.capacity == 0) {
+		return;
+	}
+	const uint32_t* pSlots = (const uint32_t*)(pData + record.slotsOffset);
+	pPool->strIdxTable.assign(pSlots, pSlots + record.capacity);
+	pPool->strIdxCount = record.count;
+}
+
+bool ResourcesIndex::restore(ResourcesParser& parser) const {
+	const byte* pData = mFile->data();
+	const IndexHeader* pHeader = (const IndexHeader*)pData;
+	ResourcesFilePtr pSource = parser.mFile;
+
+	ResourcesStream resources(pSource);
+	if(!resources.read((char*)&parser.mResourcesInfo, sizeof(ResTable_header))
+			|| parser.mResourcesInfo.packageCount != pHeader->packageCount) {
+		return false;
+	}
+	resources.seekg(pHeader->globalPoolOffset);
+	parser.mGlobalStringPool = parser.parserResStringPool(resources);
+	if(parser.mGlobalStringPool == nullptr) {
+		return false;
+	}
+	restoreStrIdx(pData, pHeader->globalStrIdx, parser.mGlobalStringPool);
+
+	const PackageRecord* pPackages = (const PackageRecord*)(pData + pHeader->packagesOffset);
+	for(uint32_t i = 0 ; i < pHeader->packageCount ; i++) {
+		const PackageRecord& record = pPackages[i];
+		ResourcesParser::PackageResourcePtr pPackage = make_shared<ResourcesParser::PackageResource>();
+		pPackage->chunkOffset = record.packageOffset;
+		if(!pSource->read(record.packageOffset, &pPackage->header, sizeof(ResTable_package))
+				|| pPackage->header.header.type != RES_TABLE_PACKAGE_TYPE
+				|| pPackage->header.id != record.packageId) {
+			return false;
+		}
+		resources.seekg(record.typesPoolOffset);
+		pPackage->pTypes = parser.parserResStringPool(resources);
+		resources.seekg(record.keysPoolOffset);
+		pPackage->pKeys = parser.parserResStringPool(resources);
+		if(pPackage->pTypes == nullptr || pPackage->pKeys == nullptr) {
+			return false;
+		}
+		restoreStrIdx(pData, record.typesStrIdx, pPackage->pTypes);
+		restoreStrIdx(pData, record.keysStrIdx, pPackage->pKeys);
+
+		// type chunk 的 header 直接从目录里拿, 和 parserPackageResource 里一样按需 load()
+		const ChunkRecord* pChunks = (const ChunkRecord*)(pData + record.chunksOffset);
+		for(uint32_t j = 0 ; j < record.chunkCount ; j++) {
+			const ChunkRecord& chunkRecord = pChunks[j];
+			ResourcesParser::ChunkInfo chunk = { chunkRecord.type, chunkRecord.offset, chunkRecord.size, nullptr, nullptr };
+			if(chunkRecord.type == RES_TABLE_TYPE_TYPE) {
+				chunk.pResTableType = make_shared<ResourcesParser::ResTableType>();
+				chunk.pResTableType->pSource = pSource;
+				chunk.pResTableType->chunkOffset = chunkRecord.offset;
+				chunk.pResTableType->header = chunkRecord.header;
+				pPackage->resTablePtrs[chunkRecord.header.id].push_back(chunk.pResTableType);
+			} else {
+				chunk.pResTableUnknown = make_shared<ResourcesParser::ResTableTypeUnknown>();
+				chunk.pResTableUnknown->pChunkAllData = pSource->view(chunkRecord.offset, chunkRecord.size);
+				if(chunk.pResTableUnknown->pChunkAllData == nullptr) {
+					return false;
+				}
+				pPackage->vecResTableUnknownPtrs.push_back(chunk.pResTableUnknown);
+			}
+			pPackage->chunks.push_back(chunk);
+		}
+
+		parser.mResourceForId[pPackage->header.id] = pPackage;
+		parser.mResourceForPackageName[StringTranscoder::utf16ToUtf8(u16string((const char16_t*)pPackage->header.name))] = pPackage;
+	}
+	return true;
+}
+
+bool ResourcesIndex::loadTypeIndex(uint32_t packageId, uint32_t typeId, ResourcesParser::TypeIndex& index) const {
+	const byte* pData = mFile->data();
+	const IndexHeader* pHeader = (const IndexHeader*)pData;
+	const PackageRecord* pPackages = (const PackageRecord*)(pData + pHeader->packagesOffset);
+	const TypeRecord* pType = nullptr;
+	for(uint32_t i = 0 ; i < pHeader->packageCount && pType == nullptr ; i++) {
+		if(pPackages[i].packageId != packageId) {
+			continue;
+		}
+		const TypeRecord* pTypes = (const TypeRecord*)(pData + pPackages[i].typesOffset);
+		for(uint32_t j = 0 ; j < pPackages[i].typeCount ; j++) {
+			if(pTypes[j].typeId == typeId) {
+				pType = pTypes + j;
+				break;
+			}
+		}
+	}
+	if(pType == nullptr || index.pResTableTypes == nullptr || pType->configCount != index.pResTableTypes->size()) {
+		return false;
+	}
+
+	const uint16_t* pFirstConfigs = (const uint16_t*)(pData + pType->firstConfigsOffset);
+	for(uint32_t i = 0 ; i < pType->entryCount ; i++) {
+		if(pFirstConfigs[i] != ResourcesParser::TypeIndex::NO_CONFIG && pFirstConfigs[i] >= pType->configCount) {
+			return false;
+		}
+	}
+	index.entryCount = pType->entryCount;
+	index.configWords = pType->configWords;
+	index.firstConfigs.assign(pFirstConfigs, pFirstConfigs + pType->entryCount);
+	const uint32_t* pKeyIndices = (const uint32_t*)(pData + pType->keyIndicesOffset);
+	index.keyIndices.assign(pKeyIndices, pKeyIndices + pType->entryCount);
+	const uint64_t* pConfigBits = (const uint64_t*)(pData + pType->configBitsOffset);
+	index.configBits.assign(pConfigBits, pConfigBits + (uint64_t)pType->entryCount * pType->configWords);
+	const uint32_t* pKeyEntries = (const uint32_t*)(pData + pType->keyEntriesOffset);
+	index.keyEntries.clear();
+	index.keyEntries.reserve(pType->keyEntryCount);
+	for(uint32_t i = 0 ; i < pType->keyEntryCount ; i++) {
+		index.keyEntries.emplace(pKeyEntries[2 * i], pKeyEntries[2 * i + 1]);
+	}
+	return true;
+}
@@ -0,0 +1,54 @@
+#ifndef RESOURCES_INDEX_H
+#define RESOURCES_INDEX_H
+
+#include "ResourcesParser.h"
+#include "ResourcesFile.h"
+
+#include <string>
+#include <memory>
+#include <stdint.h>
+
+/**
+ * resources.arsc 旁边的 .rpidx 缓存文件, 保存解析后建立的各种索引, 下次启动直接 mmap 进来用.
+ *
+ * 内容:
+ *   chunk 目录      每个 package 的所有 chunk 的位置和大小, type chunk 连同 ResTable_type header,
+ *                   恢复的时候不需要从头扫描, 也不会碰到 type chunk 所在的页
+ *   type 索引       每个 type 的 TypeIndex(每个 entry 第一个出现的 config, key, 在哪些 config 里有)
+ *   名字索引        type/key 字符串池的哈希表, 加上每个 type 按 key 排好序的 (key, entry id)
+ *   全局字符串池    的哈希表
+ * 字符串本身和 entry 数据还是按需从 resources.arsc 里读.
+ *
+ * 文件头记录了 resources.arsc 的大小, mtime 和内容的 FNV-1a 哈希. 大小和 mtime 都一样直接使用;
+ * 只有 mtime 变了的话(比如重新拷贝过)再算一遍哈希, 内容没变就更新 mtime 后继续使用, 否则作废.
+ * 格式变化时增加 VERSION, 旧版本的文件会被当成过期.
+ */
+class ResourcesIndex {
+public:
+	static const uint32_t VERSION = 1;
+
+	// 校验通过返回打开的索引, 不存在/过期/损坏返回 nullptr
+	static std::shared_ptr<ResourcesIndex> open(
+			const std::string& indexPath,
+			const std::string& sourcePath,
+			ResourcesFilePtr pSource);
+
+	// 为 parser 建立所有索引后写到 indexPath. parser 必须是刚从 sourcePath 解析出来, 没有修改过的
+	static bool write(const std::string& indexPath, const std::string& sourcePath, ResourcesParser& parser);
+
+	// 按 chunk 目录恢复 parser 的 package/字符串池/type chunk, 不扫描 resources.arsc
+	bool restore(ResourcesParser& parser) const;
+
+	// 从缓存里填充 index 除了 pResTableTypes 以外的字段, 缓存里没有这个 type 返回 false
+	bool loadTypeIndex(uint32_t packageId, uint32_t typeId, ResourcesParser::TypeIndex& index) const;
+
+private:
+	ResourcesFilePtr mFile;
+
+	ResourcesIndex(ResourcesFilePtr pFile) : mFile(pFile) {  }
+
+	bool isValid(uint32_t sourceSize) const;
+};
+typedef std::shared_ptr<ResourcesIndex> ResourcesIndexPtr;
+
+#endif  /*RESOURCES_INDEX_H*/
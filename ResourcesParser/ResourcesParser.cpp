@@ -1,11 +1,18 @@
 #include "ResourcesParser.h"
+#include "StringTranscoder.h"
+#include "ResourcesIndex.h"
 
-#include <codecvt>
-#include <locale>
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
 
 #define RETURN_UNKNOWN_ID(ID) stringstream ss; \
 	ss <<"???\(0x" <<hex <<setw(8) <<setfill('0') <<ID <<")"; \
@@ -13,6 +20,17 @@
 
 using namespace std;
 
+const uint16_t ResourcesParser::TypeIndex::NO_CONFIG;
+const uint16_t ResourcesParser::EntryPool::NO_ENTRY16;
+
+// 解析过程中的调试输出, 批量查询之类需要干净输出的场合关掉
+static bool sDebugLog = true;
+#define DEBUG_LOG if(!sDebugLog) {} else cout
+
+void ResourcesParser::setDebugLog(bool enable) {
+	sDebugLog = enable;
+}
+
 static string stringOfComplex(uint32_t complex, bool isFraction) {
 	stringstream ss;
     const float MANTISSA_MULT =
@@ -83,17 +101,82 @@ string ResourcesParser::stringOfValue(const Res_value* value) const {
 }
 
 inline static string toUtf8(const u16string& str16) {
-	return wstring_convert<codecvt_utf8_utf16<char16_t>,char16_t>()
-		.to_bytes(str16);
+	return StringTranscoder::utf16ToUtf8(str16);
 }
 
 inline static u16string toUtf16(const string& strUtf8) {
-    return wstring_convert<codecvt_utf8_utf16<char16_t>, char16_t>()
-        .from_bytes(strUtf8);
+    return StringTranscoder::utf8ToUtf16(strUtf8);
 }
 
-ResourcesParser::ResourcesParser(const string& filePath) {
-	ifstream resources(filePath, ios::in|ios::binary);
+// 字符串池里一个字符串的完整编码: 长度前缀 + 内容 + 结束符.
+// utf8 池是 utf16 字符数和 utf8 字节数两个长度, 每个超过 0x7F 时用两个字节;
+// utf16 池是一个 utf16 字符数, 超过 0x7FFF 时用两个 uint16_t.
+static string encodePoolString(const string& strUtf8, bool isUtf8Pool) {
+    const u16string str16 = toUtf16(strUtf8);
+    string encoded;
+    if (isUtf8Pool) {
+        const size_t lens[2] = { str16.size(), strUtf8.size() };
+        for (size_t len : lens) {
+            if (len > 0x7F) {
+                encoded.push_back((char)(0x80 | ((len >> 8) & 0x7F)));
+            }
+            encoded.push_back((char)(len & 0xFF));
+        }
+        encoded.append(strUtf8);
+        encoded.push_back('\0');
+    } else {
+        u16string encoded16;
+        if (str16.size() > 0x7FFF) {
+            encoded16.push_back((char16_t)(0x8000 | ((str16.size() >> 16) & 0x7FFF)));
+        }
+        encoded16.push_back((char16_t)(str16.size() & 0xFFFF));
+        encoded16.append(str16);
+        encoded16.push_back(u'\0');
+        encoded.assign((const char*)encoded16.data(), encoded16.size() * sizeof(char16_t));
+    }
+    return encoded;
+}
+
+// FNV-1a
+inline static uint32_t hashRawString(const ResourcesParser::byte* pData, uint32_t size) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i<size; ++i) {
+        hash ^= pData[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+template<typename T>
+inline static shared_ptr<T> viewAs(ResourcesStream& resources, uint32_t len) {
+	shared_ptr<ResourcesParser::byte> pData = resources.view(len);
+	return shared_ptr<T>(pData, (T*)pData.get());
+}
+
+ResourcesParser::ResourcesParser(const string& filePath, ResourcesFile::LoadMode mode, const string& indexPath) {
+	memset(&mResourcesInfo, 0, sizeof(ResTable_header));
+	mFile = ResourcesFile::open(filePath, mode);
+	if(mFile == nullptr) {
+		return;
+	}
+	if(!indexPath.empty()) {
+		mIndexFile = ResourcesIndex::open(indexPath, filePath, mFile);
+		if(mIndexFile != nullptr && mIndexFile->restore(*this)) {
+			DEBUG_LOG<<"[ResourcesIndex] restored from "<<indexPath<<endl;
+			buildIdIndex();
+			mFile->advise(ResourcesFile::ADVICE_RANDOM);
+			return;
+		}
+		// 恢复到一半失败的话丢掉已经恢复的部分, 重新解析
+		mIndexFile = nullptr;
+		memset(&mResourcesInfo, 0, sizeof(ResTable_header));
+		mGlobalStringPool = nullptr;
+		mResourceForId.clear();
+		mResourceForPackageName.clear();
+	}
+	// 解析阶段是从头到尾顺序读
+	mFile->advise(ResourcesFile::ADVICE_SEQUENTIAL);
+	ResourcesStream resources(mFile);
 
 	// resources文件开头是个ResTable_header,记录整个文件的信息
 	resources.read((char*)&mResourcesInfo, sizeof(ResTable_header));
@@ -112,8 +195,11 @@ ResourcesParser::ResourcesParser(const string& filePath) {
 		}
 		mResourceForId[pResource->header.id] = pResource;
 		mResourceForPackageName[toUtf8((char16_t*)pResource->header.name)] = pResource;
-        cout<<"[ResHeaderName]: "<<toUtf8((char16_t*)pResource->header.name)<<endl;
+        DEBUG_LOG<<"[ResHeaderName]: "<<toUtf8((char16_t*)pResource->header.name)<<endl;
 	}
+	buildIdIndex();
+	// 之后都是按 id 随机访问
+	mFile->advise(ResourcesFile::ADVICE_RANDOM);
 }
 
 void printHex(unsigned char* pBuf, unsigned int uLenBuf) {
@@ -146,15 +232,16 @@ void printChunkHeader(ResChunk_header* pChunkHeader) {
         cout<<"pChunkHeader == nullptr"<<endl;
 	return;
     }
-    cout<<"["<<pChunkHeader->type<<"]["<<pChunkHeader->headerSize<<"]["<<pChunkHeader->size<<"]"<<endl;
+    DEBUG_LOG<<"["<<pChunkHeader->type<<"]["<<pChunkHeader->headerSize<<"]["<<pChunkHeader->size<<"]"<<endl;
 
 }
 
 ResourcesParser::ResStringPoolPtr ResourcesParser::parserResStringPool(
-		ifstream& resources) {
+		ResourcesStream& resources) {
     int32_t uCur = resources.tellg();
 
 	ResStringPoolPtr pPool = make_shared<ResStringPool>();
+	pPool->chunkOffset = uCur;
 	resources.read((char*)&pPool->header, sizeof(ResStringPool_header));
     //printHex((unsigned char*)&(pPool->header), sizeof(ResStringPool_header));
 	printChunkHeader(&pPool->header.header);
@@ -162,72 +249,79 @@ ResourcesParser::ResStringPoolPtr ResourcesParser::parserResStringPool(
 		cout<<"["<<pPool->header.header.type<<"]parserResStringPool 需要定位到 RES_STRING_POOL_TYPE !"<<endl;
 		return nullptr;
 	}
-    cout<<hex<<"--[parser][StringPool]-------------------------------"<<endl;
-    cout<<"chunk_start: 0x"<<hex<<uCur<<dec<<endl;
-    cout<<"chunk size:"<<pPool->header.header.size<<endl;
-    cout<<"stringCnt:"<<pPool->header.stringCount<<endl;
-    cout<<"styleCnt:"<<pPool->header.styleCount<<endl;
-	cout<<"stringStart: 0x"<<hex<<uCur + pPool->header.stringsStart<<endl;
-	cout<<"stylesStart: 0x"<<hex<<uCur + pPool->header.stylesStart<<endl;
-    cout<<"chunk_end: 0x"<<hex<<uCur + pPool->header.header.size<<endl;
-    cout<<dec<<"-----------------------------------------------------"<<endl;
-
-	pPool->pOffsets = shared_ptr<uint32_t>(
-			new uint32_t[pPool->header.stringCount],
-			default_delete<uint32_t[]>()
-	);
+    DEBUG_LOG<<hex<<"--[parser][StringPool]-------------------------------"<<endl;
+    DEBUG_LOG<<"chunk_start: 0x"<<hex<<uCur<<dec<<endl;
+    DEBUG_LOG<<"chunk size:"<<pPool->header.header.size<<endl;
+    DEBUG_LOG<<"stringCnt:"<<pPool->header.stringCount<<endl;
+    DEBUG_LOG<<"styleCnt:"<<pPool->header.styleCount<<endl;
+	DEBUG_LOG<<"stringStart: 0x"<<hex<<uCur + pPool->header.stringsStart<<endl;
+	DEBUG_LOG<<"stylesStart: 0x"<<hex<<uCur + pPool->header.stylesStart<<endl;
+    DEBUG_LOG<<"chunk_end: 0x"<<hex<<uCur + pPool->header.header.size<<endl;
+    DEBUG_LOG<<dec<<"-----------------------------------------------------"<<endl;
 
 	const uint32_t offsetSize = sizeof(uint32_t) * pPool->header.stringCount;
-	resources.read((char*)pPool->pOffsets.get(), offsetSize);
+	pPool->pOffsets = viewAs<uint32_t>(resources, offsetSize);
+
+	// style 偏移数组紧跟在字符串偏移数组后面
+	const uint32_t styleOffsetSize = sizeof(uint32_t) * pPool->header.styleCount;
+	if(styleOffsetSize > 0) {
+		pPool->pStyleOffsets = viewAs<uint32_t>(resources, styleOffsetSize);
+	}
 
 	// 跳到字符串数组开头位置
 	uint32_t seek = pPool->header.stringsStart
 		- pPool->header.header.headerSize
-		- offsetSize;
+		- offsetSize
+		- styleOffsetSize;
 	resources.seekg(seek, ios::cur);
 
     if (seek == 0) {
-        const uint32_t styleOffsetSize = sizeof(uint32_t) * pPool->header.styleCount;
-        cout<<"[seek]:"<<seek<<", [styleOffsetSize]:"<<styleOffsetSize<<endl;
+        DEBUG_LOG<<"[seek]:"<<seek<<", [styleOffsetSize]:"<<styleOffsetSize<<endl;
     }
 
 	// 载入所有字符串
 	const uint32_t strBuffSize = pPool->header.styleCount > 0
 		? pPool->header.stylesStart - pPool->header.stringsStart
 		: pPool->header.header.size - pPool->header.stringsStart;
-	pPool->pStrings = shared_ptr<byte>(
-			new byte[strBuffSize],
-			default_delete<byte[]>()
-	);
-	resources.read((char*)pPool->pStrings.get(), strBuffSize);
+	pPool->pStrings = resources.view(strBuffSize);
 
-	// 跳出全局字符串池
+	// 载入所有 style, 同时也就跳出了字符串池
 	if(pPool->header.styleCount > 0) {
-		seek = pPool->header.header.size
-			- pPool->header.stringsStart
-			- strBuffSize;
-		resources.seekg(seek, ios::cur);
+		pPool->pStyles = resources.view(pPool->header.header.size - pPool->header.stylesStart);
 	}
 
 	return pPool;
 }
 
-string ResourcesParser::getStringFromGlobalStringPool(uint32_t index) const {
+const string& ResourcesParser::getStringFromGlobalStringPool(uint32_t index) const {
 	return getStringFromResStringPool(mGlobalStringPool, index);
 }
 
-string ResourcesParser::getStringFromResStringPool(
+const string& ResourcesParser::getStringFromResStringPool(
 			ResourcesParser::ResStringPoolPtr pPool,
 			uint32_t index) {
-	if(index > pPool->header.stringCount) {
-		return "???";
+	return pPool->getString(index);
+}
+
+const string& ResourcesParser::ResStringPool::getString(uint32_t index) {
+	static const string UNKNOWN_STRING = "???";
+	if(index >= header.stringCount) {
+		return UNKNOWN_STRING;
+	}
+	if(decodedStrings.size() != header.stringCount) {
+		// 字符串只会追加, 已经解码的部分继续有效
+		decodedStrings.resize(header.stringCount);
+		decodedFlags.resize(header.stringCount, false);
 	}
-	uint32_t offset = *(pPool->pOffsets.get() + index);
-	//前两个字节是字符串长度
-	char* str = ((char*) (pPool->pStrings.get() + offset + 2));
-	return (pPool->header.flags & ResStringPool_header::UTF8_FLAG)
-		? str
-		: toUtf8((char16_t*) str);
+	if(!decodedFlags[index]) {
+		uint32_t rawSize = 0;
+		const char* pRaw = (const char*)getRawString(index, rawSize);
+		decodedStrings[index] = (header.flags & ResStringPool_header::UTF8_FLAG)
+			? string(pRaw, rawSize)
+			: StringTranscoder::utf16ToUtf8((const char16_t*)pRaw, rawSize / sizeof(char16_t));
+		decodedFlags[index] = true;
+	}
+	return decodedStrings[index];
 }
 
 void ResourcesParser::printResStrPool(ResStringPoolPtr pResStrPool) {
@@ -248,8 +342,9 @@ void ResourcesParser::printResStrPool(ResStringPoolPtr pResStrPool) {
 }
 
 ResourcesParser::PackageResourcePtr ResourcesParser::parserPackageResource(
-		ifstream& resources) {
+		ResourcesStream& resources) {
 	PackageResourcePtr pPool = make_shared<PackageResource>();
+	pPool->chunkOffset = resources.tellg();
 	resources.read((char*)&pPool->header, sizeof(ResTable_package));
 
 	if(pPool->header.header.type != RES_TABLE_PACKAGE_TYPE) {
@@ -259,9 +354,11 @@ ResourcesParser::PackageResourcePtr ResourcesParser::parserPackageResource(
 
 	// 接着是资源类型字符串池
 	pPool->pTypes = parserResStringPool(resources);
-    printResStrPool(pPool->pTypes);
+    if (sDebugLog) {
+        printResStrPool(pPool->pTypes);
+    }
 
-    cout<< "############################" <<endl<<endl;
+    DEBUG_LOG<< "############################" <<endl<<endl;
 
 	// 接着是资源名称字符串池
 	pPool->pKeys = parserResStringPool(resources);
@@ -275,42 +372,27 @@ ResourcesParser::PackageResourcePtr ResourcesParser::parserPackageResource(
 			return pPool;
 		} else if(chunkHeader.type == RES_TABLE_TYPE_TYPE) {
 			ResTableTypePtr pResTableType = make_shared<ResTableType>();
+			pResTableType->pSource = resources.file();
+			pResTableType->chunkOffset = resources.tellg();
 			resources.read((char*)&pResTableType->header, sizeof(ResTable_type));
-//            cout<<"[after read ResTableType][0x"<<hex<<resources.tellg()<<"]["<<dec<<pResTableType->header.header.headerSize<<"]"<<endl;
-            //
-			uint32_t seek = pResTableType->header.header.headerSize - sizeof(ResTable_type);
-			resources.seekg(seek, ios::cur);
-            //cout<<"[seek]#####"<<dec<<seek<<endl;
 //            cout<<"[0x"<<hex<<chunkHeader.type<<"][0x"<<resources.tellg()<<"][ResTableTypeId]:"<<dec<<(unsigned int)pResTableType->header.id<<", [EntryCount]:"<<pResTableType->header.entryCount<<", [EntriesStart]:"<<pResTableType->header.entriesStart<<", [config]:"<<pResTableType->header.config.toString()<<endl;
 
-			pResTableType->entryPool = parserEntryPool(
-					resources,
-					pResTableType->header.entryCount,
-					pResTableType->header.entriesStart - pResTableType->header.header.headerSize,
-					pResTableType->header.header.size - pResTableType->header.entriesStart);
+			// 这里只记录 header, entry 等用到的时候再解析, 直接跳到下一个 chunk
 			pPool->resTablePtrs[pResTableType->header.id].push_back(pResTableType);
-			for(int i = 0 ; i < pResTableType->header.entryCount ; i++) {
-				ResTable_entry* pEntry = getEntryFromEntryPool(pResTableType->entryPool, i);
-				if(nullptr == pEntry) {
-					pResTableType->entries.push_back(nullptr);
-					pResTableType->values.push_back(nullptr);
-					continue;
-				}
-				Res_value* pValue = getValueFromEntry(pEntry);
-				pResTableType->entries.push_back(pEntry);
-				pResTableType->values.push_back(pValue);
-			//	cout<<"["<<pEntry->key.index<<"]"<<getStringFromResStringPool(pPool->pKeys,pEntry->key.index)<<endl;
-			}
+			ChunkInfo chunk = { chunkHeader.type, pResTableType->chunkOffset, chunkHeader.size, pResTableType, nullptr };
+			pPool->chunks.push_back(chunk);
+			resources.seekg(pResTableType->chunkOffset + chunkHeader.size);
 		} else {
-            cout<<"[0x"<<hex<<chunkHeader.type<<"] size:0x"<<chunkHeader.size<<dec<<endl;
+            DEBUG_LOG<<"[0x"<<hex<<chunkHeader.type<<"] size:0x"<<chunkHeader.size<<dec<<endl;
 //			resources.seekg(chunkHeader.size, ios::cur);
 			ResTableTypeUnknownPtr pResTableTypeUnknownPtr = make_shared<ResTableTypeUnknown>();
-            pResTableTypeUnknownPtr->pChunkAllData = shared_ptr<byte>(
-			    new byte[chunkHeader.size],
-                default_delete<byte[]>()
-            );
-			resources.read((char*)pResTableTypeUnknownPtr->pChunkAllData.get(), chunkHeader.size);
+            ChunkInfo chunk = { chunkHeader.type, resources.tellg(), chunkHeader.size, nullptr, pResTableTypeUnknownPtr };
+            pResTableTypeUnknownPtr->pChunkAllData = resources.view(chunkHeader.size);
+            if(pResTableTypeUnknownPtr->pChunkAllData == nullptr) {
+                break;
+            }
             pPool->vecResTableUnknownPtrs.push_back(pResTableTypeUnknownPtr);
+            pPool->chunks.push_back(chunk);
 
             //printHex((unsigned char*)pResTableTypeUnknownPtr->pChunkAllData.get(), sizeof(ResChunk_header));
             
@@ -320,38 +402,90 @@ ResourcesParser::PackageResourcePtr ResourcesParser::parserPackageResource(
 	return pPool;
 }
 
+void ResourcesParser::ResTableType::load() {
+	if(isLoaded) {
+		return;
+	}
+	isLoaded = true;
+	if(pSource == nullptr) {
+		return;
+	}
+
+	ResourcesStream resources(pSource, chunkOffset + header.header.headerSize);
+	entryPool = parserEntryPool(
+			resources,
+			header.entryCount,
+			header.entriesStart - header.header.headerSize,
+			header.header.size - header.entriesStart,
+			header.flags);
+	// 稀疏编码时 entries/values 还是按 entry id 下标存放
+	const uint32_t entryCount = entryPool.getEntryCount();
+	entries.reserve(entryCount);
+	values.reserve(entryCount);
+	for(uint32_t i = 0 ; i < entryCount ; i++) {
+		ResTable_entry* pEntry = getEntryFromEntryPool(entryPool, i);
+		if(nullptr == pEntry) {
+			entries.push_back(nullptr);
+			values.push_back(nullptr);
+			continue;
+		}
+		entries.push_back(pEntry);
+		values.push_back(getValueFromEntry(pEntry));
+	}
+}
+
 ResourcesParser::EntryPool ResourcesParser::parserEntryPool(
-			ifstream& resources,
+			ResourcesStream& resources,
 			uint32_t entryCount,
 			uint32_t dataStart,
-			uint32_t dataSize) {
+			uint32_t dataSize,
+			uint8_t typeFlags) {
 	EntryPool pool;
-	pool.pOffsets = shared_ptr<uint32_t>(
-			new uint32_t[entryCount],
-			default_delete<uint32_t[]>()
-	);
-
-	const uint32_t offsetSize = sizeof(uint32_t) * entryCount;
-	resources.read((char*)pool.pOffsets.get(), offsetSize);
+	pool.isSparse = typeFlags & ResTable_type::FLAG_SPARSE;
+	pool.isOffset16 = !pool.isSparse && (typeFlags & ResTable_type::FLAG_OFFSET16);
+	const uint32_t offsetSize = (pool.isOffset16 ? sizeof(uint16_t) : sizeof(uint32_t)) * entryCount;
+	pool.pOffsets = viewAs<uint32_t>(resources, offsetSize);
 
 	pool.offsetCount = entryCount;
 	pool.dataSize = dataSize;
 
 	resources.seekg(dataStart - offsetSize, ios::cur);
 
-	pool.pData = shared_ptr<byte>(
-			new byte[pool.dataSize],
-			default_delete<byte[]>()
-	);
-	resources.read((char*)pool.pData.get(), pool.dataSize);
+	pool.pData = resources.view(pool.dataSize);
 	return pool;
 }
 
-ResTable_entry* ResourcesParser::getEntryFromEntryPool(EntryPool pool, uint32_t index) {
-	if(index >= pool.offsetCount) {
-		return nullptr;
+uint32_t ResourcesParser::EntryPool::getEntryCount() const {
+	if(!isSparse) {
+		return offsetCount;
+	}
+	// 按 entry id 排好序, 最后一个就是最大的 id
+	return offsetCount > 0 ? ((const ResTable_sparseTypeEntry*)pOffsets.get())[offsetCount - 1].idx + 1 : 0;
+}
+
+ResTable_entry* ResourcesParser::getEntryFromEntryPool(const EntryPool& pool, uint32_t index) {
+	uint32_t offset = ResTable_type::NO_ENTRY;
+	if(pool.isSparse) {
+		// 二分查找 entry id, offset 是按 4 字节计的
+		const ResTable_sparseTypeEntry* pBegin = (const ResTable_sparseTypeEntry*)pool.pOffsets.get();
+		const ResTable_sparseTypeEntry* pEnd = pBegin + pool.offsetCount;
+		const ResTable_sparseTypeEntry* pFound = lower_bound(pBegin, pEnd, index,
+				[](const ResTable_sparseTypeEntry& entry, uint32_t idx) {
+			return entry.idx < idx;
+		});
+		if(pFound != pEnd && pFound->idx == index) {
+			offset = pFound->offset * 4u;
+		}
+	} else if(pool.isOffset16) {
+		if(index < pool.offsetCount) {
+			const uint16_t offset16 = ((const uint16_t*)pool.pOffsets.get())[index];
+			if(offset16 != EntryPool::NO_ENTRY16) {
+				offset = offset16 * 4u;
+			}
+		}
+	} else if(index < pool.offsetCount) {
+		offset = *(pool.pOffsets.get() + index);
 	}
-	uint32_t offset = *(pool.pOffsets.get() + index);
 	if(offset == ResTable_type::NO_ENTRY) {
 		return nullptr;
 	}
@@ -366,52 +500,234 @@ ResTable_map* ResourcesParser::getMapsFromEntry(const ResTable_entry* pEntry) {
 	return (ResTable_map*)(((byte*)pEntry) + pEntry->size);
 }
 
+uint32_t ResourcesParser::getEntrySize(const ResTable_entry* pEntry) {
+	if(pEntry->flags & ResTable_entry::FLAG_COMPLEX) {
+		return pEntry->size + ((const ResTable_map_entry*)pEntry)->count * sizeof(ResTable_map);
+	}
+	return pEntry->size + getValueFromEntry(pEntry)->size;
+}
+
 
 ResourcesParser::PackageResourcePtr ResourcesParser::getPackageResouceForId(uint32_t id) const {
 	uint32_t packageId = (id >> 24);
-	auto it = mResourceForId.find(packageId);
-	if(it==mResourceForId.end()) {
+	if(packageId >= mIdIndex.size()) {
 		return nullptr;
 	}
-	return it->second;
+	return mIdIndex[packageId].pPackage;
 }
 
-vector<ResourcesParser::ResTableTypePtr> ResourcesParser::getResTableTypesForId(uint32_t id) {
-	PackageResourcePtr pPackage = getPackageResouceForId(id);
+void ResourcesParser::buildIdIndex() {
+	// package/type 这一层在解析完就建好, entry 这一层等第一次访问这个 type 的时候再建
+	mIdIndex.assign(256, PackageIndex());
+	for(auto& item : mResourceForId) {
+		PackageIndex& packageIndex = mIdIndex[item.first & 0xFF];
+		packageIndex.pPackage = item.second;
+		packageIndex.types.assign(256, TypeIndex());
+		for(auto& typeItem : item.second->resTablePtrs) {
+			packageIndex.types[typeItem.first & 0xFF].pResTableTypes = &typeItem.second;
+		}
+	}
+}
+
+const ResourcesParser::TypeIndex* ResourcesParser::getTypeIndexForId(uint32_t id) const {
+	uint32_t packageId = (id >> 24);
+	if(packageId >= mIdIndex.size() || mIdIndex[packageId].pPackage == nullptr) {
+		return nullptr;
+	}
+	TypeIndex& index = mIdIndex[packageId].types[TYPE_ID(id)];
+	if(index.pResTableTypes == nullptr) {
+		return nullptr;
+	}
+	if(index.isBuilt) {
+		return &index;
+	}
+	if(mIndexFile != nullptr && mIndexFile->loadTypeIndex(packageId, TYPE_ID(id), index)) {
+		index.isBuilt = true;
+		return &index;
+	}
+
+	const vector<ResTableTypePtr>& resTableTypePtrs = *index.pResTableTypes;
+	index.entryCount = 0;
+	for(ResTableTypePtr pResTableType : resTableTypePtrs) {
+		pResTableType->load();
+		index.entryCount = max(index.entryCount, (uint32_t)pResTableType->entries.size());
+	}
+	index.configWords = (resTableTypePtrs.size() + 63) / 64;
+	index.firstConfigs.assign(index.entryCount, TypeIndex::NO_CONFIG);
+	index.keyIndices.assign(index.entryCount, ResTable_type::NO_ENTRY);
+	index.configBits.assign(index.entryCount * index.configWords, 0);
+	index.keyEntries.clear();
+	index.keyEntries.reserve(index.entryCount);
+	for(uint32_t config = 0 ; config < resTableTypePtrs.size() ; config++) {
+		const vector<ResTable_entry*>& entries = resTableTypePtrs[config]->entries;
+		for(uint32_t entryId = 0 ; entryId < entries.size() ; entryId++) {
+			if(entries[entryId] == nullptr) {
+				continue;
+			}
+			index.configBits[entryId * index.configWords + config / 64] |= (uint64_t)1 << (config % 64);
+			if(index.firstConfigs[entryId] == TypeIndex::NO_CONFIG) {
+				index.firstConfigs[entryId] = config;
+				index.keyIndices[entryId] = entries[entryId]->key.index;
+			}
+		}
+	}
+	// 同一个 key 出现在多个 entry 上时用最小的 entry id
+	for(uint32_t entryId = 0 ; entryId < index.entryCount ; entryId++) {
+		if(index.firstConfigs[entryId] != TypeIndex::NO_CONFIG) {
+			index.keyEntries.emplace(index.keyIndices[entryId], entryId);
+		}
+	}
+	index.isBuilt = true;
+	return &index;
+}
+
+const ResTable_entry* ResourcesParser::getFirstEntryForId(uint32_t id) const {
+	const TypeIndex* pIndex = getTypeIndexForId(id);
+	if(pIndex == nullptr
+			|| ENTRY_ID(id) >= pIndex->entryCount
+			|| pIndex->firstConfigs[ENTRY_ID(id)] == TypeIndex::NO_CONFIG) {
+		return nullptr;
+	}
+	// 索引是从 .rpidx 读进来的话这个 config 可能还没有 load()
+	ResTableTypePtr pResTableType = (*pIndex->pResTableTypes)[pIndex->firstConfigs[ENTRY_ID(id)]];
+	pResTableType->load();
+	return pResTableType->entries[ENTRY_ID(id)];
+}
+
+uint32_t ResourcesParser::getIdForName(
+		const string& packageName,
+		const string& type,
+		const string& name) const {
+	PackageResourcePtr pPackage = nullptr;
+	if(packageName.empty()) {
+		if(!mResourceForPackageName.empty()) {
+			pPackage = mResourceForPackageName.begin()->second;
+		}
+	} else {
+		auto it = mResourceForPackageName.find(packageName);
+		if(it != mResourceForPackageName.end()) {
+			pPackage = it->second;
+		}
+	}
 	if(pPackage == nullptr) {
-		return vector<ResTableTypePtr>();
+		return 0;
 	}
-	return pPackage->resTablePtrs[TYPE_ID(id)];
+
+	// type 和 key 都是字符串池的哈希查找, type id 是 type 字符串的 index + 1
+	uint32_t typeIdx = pPackage->pTypes->getStrIdx(type);
+	uint32_t keyIdx = pPackage->pKeys->getStrIdx(name);
+	if(typeIdx == (uint32_t)-1 || keyIdx == (uint32_t)-1) {
+		return 0;
+	}
+	uint32_t typeId = (pPackage->header.id << 24) | ((typeIdx + 1) << 16);
+	const TypeIndex* pIndex = getTypeIndexForId(typeId);
+	if(pIndex == nullptr) {
+		return 0;
+	}
+	auto it = pIndex->keyEntries.find(keyIdx);
+	if(it == pIndex->keyEntries.end()) {
+		return 0;
+	}
+	return typeId | it->second;
 }
 
-string ResourcesParser::getNameForId(uint32_t id) const {
+void ResourcesParser::invalidateTypeIndex(uint32_t id) {
 	PackageResourcePtr pPackage = getPackageResouceForId(id);
 	if(pPackage == nullptr) {
-		RETURN_UNKNOWN_ID(id);
+		return;
 	}
-	uint32_t typeId = TYPE_ID(id);
-	if(pPackage->resTablePtrs.find(typeId)==pPackage->resTablePtrs.end()) {
-		RETURN_UNKNOWN_ID(id);
+	// 缓存里的索引和修改后的内容对不上了
+	mIndexFile = nullptr;
+	TypeIndex& index = mIdIndex[id >> 24].types[TYPE_ID(id)];
+	auto it = pPackage->resTablePtrs.find(TYPE_ID(id));
+	index.pResTableTypes = (it == pPackage->resTablePtrs.end() ? nullptr : &it->second);
+	index.isBuilt = false;
+}
+
+const vector<ResourcesParser::ResTableTypePtr>& ResourcesParser::getResTableTypesForId(uint32_t id) {
+	static const vector<ResTableTypePtr> EMPTY_TYPES;
+	const TypeIndex* pIndex = getTypeIndexForId(id);
+	if(pIndex == nullptr) {
+		return EMPTY_TYPES;
+	}
+	for(ResTableTypePtr pResTableType : *pIndex->pResTableTypes) {
+		pResTableType->load();
 	}
+	return *pIndex->pResTableTypes;
+}
 
-	uint32_t entryId = ENTRY_ID(id);
+void ResourcesParser::loadAllResTableTypes(int jobCount) {
+	vector<ResTableTypePtr> pending;
+	for(auto& item : mResourceForId) {
+		for(const ChunkInfo& chunk : item.second->chunks) {
+			if(chunk.pResTableType != nullptr && !chunk.pResTableType->isLoaded) {
+				pending.push_back(chunk.pResTableType);
+			}
+		}
+	}
 
-	if(pPackage->resTablePtrs[typeId][0]->header.entryCount<=(entryId)){
-		RETURN_UNKNOWN_ID(id);
+	if(jobCount <= 0) {
+		jobCount = thread::hardware_concurrency();
+	}
+	if(jobCount > (int)pending.size()) {
+		jobCount = pending.size();
+	}
+	if(jobCount <= 1) {
+		for(ResTableTypePtr pResTableType : pending) {
+			pResTableType->load();
+		}
+		return;
 	}
 
-	const ResTable_entry* pEntry = nullptr;
-	for(ResTableTypePtr  pResTableType : pPackage->resTablePtrs[typeId]) {
-		pEntry = pResTableType->entries[entryId];
-		if(pEntry) {
-			break;
+	// 各个 type chunk 之间互不依赖, 每个线程从队列里取下一个解析
+	atomic<size_t> next(0);
+	vector<thread> workers;
+	for(int i = 0 ; i < jobCount ; i++) {
+		workers.push_back(thread([&pending, &next]() {
+			for(size_t idx = next++ ; idx < pending.size() ; idx = next++) {
+				pending[idx]->load();
+			}
+		}));
+	}
+	for(thread& worker : workers) {
+		worker.join();
+	}
+}
+
+void ResourcesParser::prepareForSharedReads(int jobCount) {
+	loadAllResTableTypes(jobCount);
+
+	vector<ResStringPoolPtr> pools;
+	pools.push_back(mGlobalStringPool);
+	for(auto& item : mResourceForId) {
+		pools.push_back(item.second->pTypes);
+		pools.push_back(item.second->pKeys);
+		for(auto& typeItem : item.second->resTablePtrs) {
+			getTypeIndexForId((item.first << 24) | (typeItem.first << 16));
 		}
 	}
+	for(ResStringPoolPtr pPool : pools) {
+		if(pPool == nullptr) {
+			continue;
+		}
+		for(uint32_t i = 0 ; i < pPool->header.stringCount ; i++) {
+			pPool->getString(i);
+		}
+		if(pPool->strIdxTable.empty()) {
+			pPool->buildStrIdxTable();
+		}
+	}
+}
 
-	if(pEntry == nullptr) {
+string ResourcesParser::getNameForId(uint32_t id) const {
+	const TypeIndex* pIndex = getTypeIndexForId(id);
+	uint32_t entryId = ENTRY_ID(id);
+	if(pIndex == nullptr
+			|| entryId >= pIndex->entryCount
+			|| pIndex->keyIndices[entryId] == ResTable_type::NO_ENTRY) {
 		RETURN_UNKNOWN_ID(id);
 	}
-	return getStringFromResStringPool(getPackageResouceForId(id)->pKeys, pEntry->key.index);
+	return getStringFromResStringPool(mIdIndex[id >> 24].pPackage->pKeys, pIndex->keyIndices[entryId]);
 }
 
 string ResourcesParser::getNameForResTableMap(const ResTable_ref& ref) const {
@@ -488,61 +804,78 @@ string ResourcesParser::getValueTypeForResTableMap(const Res_value& value) const
 	}
 }
 
-uint32_t ResourcesParser::ResStringPool::addNewString(std::string& newStr) {
-    uint32_t uTotalAdd = 0;
+uint32_t ResourcesParser::ResStringPool::addNewString(const std::string& newStr) {
+    return addNewStrings(std::vector<std::string>(1, newStr));
+}
 
-    // 开始增加字符串长度和内容
-    const uint32_t sizeStrBufOrigin = header.styleCount > 0
+// 当前字符串数组(含末尾对齐填充)的大小
+uint32_t ResourcesParser::ResStringPool::getStringsSize() const {
+    return header.styleCount > 0
         ? header.stylesStart - header.stringsStart
         : header.header.size - header.stringsStart;
-    uint8_t uLenStrNew = newStr.size(); // 无论 utf8 还是 utf16， 这里记录的是字符数，不包括最后的 0 结束符.
-    cout<<"[ROM_DEBUG] len:"<<newStr.length()<<", size:"<<newStr.size()<<endl;
-    uint32_t uSizeNewStrBufAdd = 0;
-    if (header.flags & ResStringPool_header::UTF8_FLAG) {
-        uSizeNewStrBufAdd = 2 + uLenStrNew + 1; 
-        uint32_t uSizeBufNew = uSizeNewStrBufAdd + sizeStrBufOrigin; 
-        shared_ptr<byte> pBufStrDataNew = shared_ptr<byte>(new byte[uSizeBufNew], default_delete<byte[]>());
-        memset(pBufStrDataNew.get(), 0, uSizeBufNew);
-        memcpy(pBufStrDataNew.get(), &uLenStrNew, 1);
-        memcpy(pBufStrDataNew.get() + 1, &uLenStrNew, 1);
-        memcpy(pBufStrDataNew.get() + 2, newStr.c_str(), uLenStrNew + 1);
-        memcpy(pBufStrDataNew.get() + uSizeNewStrBufAdd, pStrings.get(), sizeStrBufOrigin); //把老数据拷贝过去.
-        pStrings.swap(pBufStrDataNew);
-        //
-        uTotalAdd += uSizeNewStrBufAdd;
-    } else {
-        u16string newStr16 = toUtf16(newStr);
-        uSizeNewStrBufAdd = 2 + (uLenStrNew + 1)*2; 
-        uint16_t uSizeBufNew = uSizeNewStrBufAdd + sizeStrBufOrigin;
-        shared_ptr<byte> pBufStrDataNew = shared_ptr<byte>(new byte[uSizeBufNew], default_delete<byte[]>());
-        memset(pBufStrDataNew.get(), 0, uSizeBufNew);
-        memcpy(pBufStrDataNew.get(), &uLenStrNew, 1);
-        memcpy(pBufStrDataNew.get() + 1, &uLenStrNew, 1);
-        memcpy(pBufStrDataNew.get() + 2, newStr.c_str(), (uLenStrNew + 1)*2);
-        memcpy(pBufStrDataNew.get() + uSizeNewStrBufAdd, pStrings.get(), sizeStrBufOrigin); //把老数据拷贝过去.
-        pStrings.swap(pBufStrDataNew);
-        //
-        uTotalAdd += uSizeNewStrBufAdd;
+}
+
+// 新字符串追加在末尾, 已有字符串的 index 和 offset 都不变.
+// pOffsets/pStrings 按容量翻倍增长, 连续添加 N 个字符串总的拷贝量是 O(N).
+uint32_t ResourcesParser::ResStringPool::addNewStrings(const std::vector<std::string>& newStrs) {
+    if (newStrs.empty()) {
+        return 0;
     }
-    
-    // add new string offset
-    std::shared_ptr<uint32_t> pOffsetsNew = shared_ptr<uint32_t>(
-        new uint32_t[header.stringCount+1],
-        default_delete<uint32_t[]>()
-    );
-    *(pOffsetsNew.get()) = 0;
-    for (uint32_t idx = 0; idx<header.stringCount; ++idx) {
-       *(pOffsetsNew.get() + 1 + idx) = *(pOffsets.get() + idx) + uSizeNewStrBufAdd;
+    isDirty = true;
+    const uint32_t addCount = newStrs.size();
+    const uint32_t sizeStrBufOrigin = getStringsSize();
+    if (stringsCapacity == 0) {
+        // 还指向解析出来的原始数据, 原来的对齐填充也当作已用的部分
+        stringsUsed = sizeStrBufOrigin;
     }
-    // 交换内存
-    pOffsets.swap(pOffsetsNew);
-    // 记录 offset 新增内存大小
-    uTotalAdd += sizeof(uint32_t);
 
-    // 字符串统计+1
-    header.stringCount += 1; 
+    // 按字符串池的编码生成 长度 + 内容 + 结束符, 一次算好总大小
+    const bool isUtf8Pool = header.flags & ResStringPool_header::UTF8_FLAG;
+    std::string newStrsEncoded;
+    std::vector<uint32_t> newOffsets;
+    newOffsets.reserve(addCount);
+    for (const std::string& newStr : newStrs) {
+        newOffsets.push_back(stringsUsed + newStrsEncoded.size());
+        newStrsEncoded.append(encodePoolString(newStr, isUtf8Pool));
+    }
+    const uint32_t newUsed = stringsUsed + newStrsEncoded.size();
+    // 字符串数组要按 4 字节对齐
+    const uint32_t sizeStrBufNew = (newUsed + 3) & ~3u;
+
+    // offset 数组
+    const uint32_t newCount = header.stringCount + addCount;
+    if (offsetsCapacity < newCount) {
+        uint32_t capacity = std::max(newCount, offsetsCapacity * 2);
+        std::shared_ptr<uint32_t> pOffsetsNew = shared_ptr<uint32_t>(
+            new uint32_t[capacity],
+            default_delete<uint32_t[]>()
+        );
+        if (header.stringCount > 0) {
+            memcpy(pOffsetsNew.get(), pOffsets.get(), header.stringCount*sizeof(uint32_t));
+        }
+        pOffsets.swap(pOffsetsNew);
+        offsetsCapacity = capacity;
+    }
+    memcpy(pOffsets.get() + header.stringCount, newOffsets.data(), addCount*sizeof(uint32_t));
+
+    // 字符串数组, 多出来的部分清零, 对齐填充直接写出去就是 0
+    if (stringsCapacity < sizeStrBufNew) {
+        uint32_t capacity = std::max(sizeStrBufNew, stringsCapacity * 2);
+        shared_ptr<byte> pBufStrDataNew = shared_ptr<byte>(new byte[capacity], default_delete<byte[]>());
+        memcpy(pBufStrDataNew.get(), pStrings.get(), stringsUsed);
+        memset(pBufStrDataNew.get() + stringsUsed, 0, capacity - stringsUsed);
+        pStrings.swap(pBufStrDataNew);
+        stringsCapacity = capacity;
+    }
+    memcpy(pStrings.get() + stringsUsed, newStrsEncoded.data(), newStrsEncoded.size());
+    stringsUsed = newUsed;
+
+    const uint32_t uTotalAdd = addCount*sizeof(uint32_t) + (sizeStrBufNew - sizeStrBufOrigin);
+
+    // 字符串统计
+    header.stringCount = newCount;
     // update meta data.
-    header.stringsStart += sizeof(uint32_t);
+    header.stringsStart += addCount*sizeof(uint32_t);
     // 调码整 style起始位置, style偏移数组里面的值. 
     if (header.stylesStart > 0) {
         header.stylesStart += uTotalAdd;
@@ -552,70 +885,132 @@ uint32_t ResourcesParser::ResStringPool::addNewString(std::string& newStr) {
     header.header.size += uTotalAdd;
     cout<<"[StringPoolSize]now:" <<header.header.size << ", uTotalAdd:" << uTotalAdd <<endl;
 
+    // 已有的 index 不变, 解码缓存和哈希表只需要补上新的部分
+    if (!strIdxTable.empty()) {
+        for (uint32_t idx = newCount - addCount; idx<newCount; ++idx) {
+            insertStrIdx(idx);
+        }
+    }
+
     return uTotalAdd;
 }
 
-uint32_t ResourcesParser::ResStringPool::addNewString_old(std::string& newStr) {
-    uint32_t uTotalAdd = 0;
-    std::shared_ptr<uint32_t> pOffsetsNew = shared_ptr<uint32_t>(
-        new uint32_t[header.stringCount+1],
-        default_delete<uint32_t[]>()
-    );
-    // add new string offset)
-    memcpy(pOffsetsNew.get(), pOffsets.get(), header.stringCount*sizeof(uint32_t));
-    uint32_t newStringStart = (header.styleCount > 0)
-        ? (header.stylesStart - header.stringsStart)
-        : (header.header.size - header.stringsStart);
-    *(pOffsetsNew.get() + header.stringCount) = newStringStart; 
-    // 交换内存
-    pOffsets.swap(pOffsetsNew);
-
-    // 记录 offset 新增内存大小
-    uTotalAdd += sizeof(uint32_t);
-
-    // 开始增加字符串长度和内容
-    const uint32_t sizeStrBufOrigin = header.styleCount > 0
-        ? header.stylesStart - header.stringsStart
-        : header.header.size - header.stringsStart;
-    uint8_t uLenStrNew = newStr.size(); // 无论 utf8 还是 utf16， 这里记录的是字符数，不包括最后的 0 结束符.
-    cout<<"[ROM_DEBUG] len:"<<newStr.length()<<", size:"<<newStr.size()<<endl;
-    if (header.flags & ResStringPool_header::UTF8_FLAG) {
-        uint32_t uSizeBufNew = sizeStrBufOrigin + (2 + uLenStrNew + 1);
-        shared_ptr<byte> pBufStrDataNew = shared_ptr<byte>(new byte[uSizeBufNew], default_delete<byte[]>());
-        memset(pBufStrDataNew.get(), 0, uSizeBufNew);
-        memcpy(pBufStrDataNew.get(), pStrings.get(), sizeStrBufOrigin); // 把之前老的复制到前面.
-        memcpy(pBufStrDataNew.get() + sizeStrBufOrigin, &uLenStrNew, 1); // 写新添加字符串的长度
-        memcpy(pBufStrDataNew.get() + sizeStrBufOrigin + 1, &uLenStrNew, 1); // 写新添加字符串的长度
-        memcpy(pBufStrDataNew.get() + sizeStrBufOrigin + 2, newStr.c_str(), uLenStrNew + 1); // 把空结束符的字符串拷贝进去
-        pStrings.swap(pBufStrDataNew);
-        //
-        uTotalAdd += (uSizeBufNew - sizeStrBufOrigin);
-    } else {
-        u16string newStr16 = toUtf16(newStr);
-        uint16_t uSizeBufNew = 2 + (uLenStrNew + 1)*2;
-        shared_ptr<byte> pBufStrDataNew = shared_ptr<byte>(new byte[uSizeBufNew], default_delete<byte[]>());
-        memset(pBufStrDataNew.get(), 0, uSizeBufNew);
-        memcpy(pBufStrDataNew.get(), pStrings.get(), sizeStrBufOrigin);
-        memcpy(pBufStrDataNew.get() + sizeStrBufOrigin, &uLenStrNew, 2); // 写新添加字符串的长度.
-        memcpy(pBufStrDataNew.get() + sizeStrBufOrigin + 2, newStr16.c_str(), (uLenStrNew+1)*2 ); // 
-        pStrings.swap(pBufStrDataNew);
-        //
-        uTotalAdd += (uSizeBufNew - sizeStrBufOrigin);
+uint32_t ResourcesParser::ResStringPool::removeStrings(std::vector<bool> keep, std::vector<uint32_t>& remap) {
+    const uint32_t stringCount = header.stringCount;
+    const uint32_t styleCount = header.styleCount;
+    keep.resize(stringCount, false);
+    auto getSpans = [this](uint32_t index) {
+        return (const ResStringPool_span*)(pStyles.get() + pStyleOffsets.get()[index]);
+    };
+
+    // span 的名字本身也可能带 style, 一直找到没有新的名字为止
+    std::vector<uint32_t> pending;
+    for (uint32_t i = 0; i < styleCount; ++i) {
+        if (keep[i]) {
+            pending.push_back(i);
+        }
     }
-    
-    // 字符串统计+1
-    header.stringCount += 1; 
-    // update meta data.
-    header.stringsStart += sizeof(uint32_t);
-    // 调码整 style起始位置, style偏移数组里面的值. 
-    if (header.stylesStart > 0) {
-        header.stylesStart += uTotalAdd;
+    while (!pending.empty()) {
+        const uint32_t index = pending.back();
+        pending.pop_back();
+        for (const ResStringPool_span* pSpan = getSpans(index); pSpan->name.index != ResStringPool_span::END; ++pSpan) {
+            const uint32_t name = pSpan->name.index;
+            if (name < stringCount && !keep[name]) {
+                keep[name] = true;
+                if (name < styleCount) {
+                    pending.push_back(name);
+                }
+            }
+        }
     }
-    
-    // 整体字符串包大小也要改.
-    header.header.size += uTotalAdd;
-    //
-    return uTotalAdd;
+
+    // 字符串原样拷贝(长度 + 内容 + 结束符), 原来共用同一份数据的继续共用
+    const uint32_t terminatorSize = (header.flags & ResStringPool_header::UTF8_FLAG) ? 1 : sizeof(char16_t);
+    remap.assign(stringCount, (uint32_t)-1);
+    std::vector<uint32_t> offsets;
+    std::string strings;
+    std::map<uint32_t, uint32_t> copied;
+    for (uint32_t i = 0; i < stringCount; ++i) {
+        if (!keep[i]) {
+            continue;
+        }
+        remap[i] = offsets.size();
+        const uint32_t offset = pOffsets.get()[i];
+        auto it = copied.find(offset);
+        if (it != copied.end()) {
+            offsets.push_back(it->second);
+            continue;
+        }
+        uint32_t rawSize = 0;
+        const byte* pRaw = getRawString(i, rawSize);
+        const byte* pStart = pStrings.get() + offset;
+        copied[offset] = strings.size();
+        offsets.push_back(strings.size());
+        strings.append((const char*)pStart, (pRaw - pStart) + rawSize + terminatorSize);
+    }
+
+    // 带 style 的字符串排在最前面, 保留下来的还是在最前面, style 按同样的顺序排
+    std::vector<uint32_t> styleOffsets;
+    std::string styles;
+    const uint32_t end = ResStringPool_span::END;
+    for (uint32_t i = 0; i < styleCount; ++i) {
+        if (!keep[i]) {
+            continue;
+        }
+        styleOffsets.push_back(styles.size());
+        for (const ResStringPool_span* pSpan = getSpans(i); pSpan->name.index != ResStringPool_span::END; ++pSpan) {
+            ResStringPool_span span = *pSpan;
+            if (span.name.index < stringCount) {
+                span.name.index = remap[span.name.index];
+            }
+            styles.append((const char*)&span, sizeof(ResStringPool_span));
+        }
+        styles.append((const char*)&end, sizeof(end));
+    }
+    if (!styleOffsets.empty()) {
+        // 和 aapt 一样, 最后再补上两个 END, 凑够一个完整的 ResStringPool_span
+        styles.append((const char*)&end, sizeof(end));
+        styles.append((const char*)&end, sizeof(end));
+    }
+
+    // 换上新的数组, 缓冲区大小正好是最终大小
+    const uint32_t newCount = offsets.size();
+    const uint32_t newStyleCount = styleOffsets.size();
+    const uint32_t stringsSize = (strings.size() + 3) & ~3u;
+    pOffsets = shared_ptr<uint32_t>(new uint32_t[std::max(newCount, 1u)], default_delete<uint32_t[]>());
+    if (newCount > 0) {
+        memcpy(pOffsets.get(), offsets.data(), newCount * sizeof(uint32_t));
+    }
+    pStyleOffsets = shared_ptr<uint32_t>(new uint32_t[std::max(newStyleCount, 1u)], default_delete<uint32_t[]>());
+    if (newStyleCount > 0) {
+        memcpy(pStyleOffsets.get(), styleOffsets.data(), newStyleCount * sizeof(uint32_t));
+    }
+    pStrings = shared_ptr<byte>(new byte[std::max(stringsSize, 1u)], default_delete<byte[]>());
+    memset(pStrings.get(), 0, std::max(stringsSize, 1u));
+    memcpy(pStrings.get(), strings.data(), strings.size());
+    pStyles = shared_ptr<byte>(new byte[std::max<uint32_t>(styles.size(), 1u)], default_delete<byte[]>());
+    if (!styles.empty()) {
+        memcpy(pStyles.get(), styles.data(), styles.size());
+    }
+    stringsUsed = strings.size();
+    stringsCapacity = std::max(stringsSize, 1u);
+    offsetsCapacity = std::max(newCount, 1u);
+
+    const uint32_t oldSize = header.header.size;
+    header.header.headerSize = sizeof(ResStringPool_header);
+    header.stringCount = newCount;
+    header.styleCount = newStyleCount;
+    header.stringsStart = sizeof(ResStringPool_header) + sizeof(uint32_t) * (newCount + newStyleCount);
+    header.stylesStart = newStyleCount > 0 ? header.stringsStart + stringsSize : 0;
+    header.header.size = header.stringsStart + stringsSize + styles.size();
+    isDirty = true;
+
+    // index 全变了, 解码缓存和哈希表都作废
+    decodedStrings.clear();
+    decodedFlags.clear();
+    strIdxTable.clear();
+    strIdxCount = 0;
+    return oldSize - header.header.size;
 }
 
 // return -1 measn failed. others means success.
@@ -626,70 +1021,244 @@ uint32_t ResourcesParser::ResStringPool::getStrIdx(const std::string& destStr) {
     if (header.stringCount == 0) {
         return -1;
     }
-    for (uint32_t idx = 0; idx<header.stringCount; ++idx) {
-        uint32_t offset = *(pOffsets.get() + idx);
-        char* str = ((char*)(pStrings.get() + offset + 2));
-        std::string itemStr = (header.flags & ResStringPool_header::UTF8_FLAG) ? str : toUtf8((char16_t*)str);
-        if (itemStr.compare(destStr) == 0) {
-            return idx;
+    if (strIdxTable.empty()) {
+        buildStrIdxTable();
+    }
+
+    // 把要找的字符串转成字符串池自己的编码, 直接比较原始字节
+    const byte* pDest = (const byte*)destStr.data();
+    uint32_t destSize = destStr.size();
+    u16string destStr16;
+    if (!(header.flags & ResStringPool_header::UTF8_FLAG)) {
+        destStr16 = toUtf16(destStr);
+        pDest = (const byte*)destStr16.data();
+        destSize = destStr16.size() * sizeof(char16_t);
+    }
+
+    const uint32_t mask = strIdxTable.size() - 1;
+    for (uint32_t pos = hashRawString(pDest, destSize) & mask; strIdxTable[pos] != 0; pos = (pos + 1) & mask) {
+        uint32_t rawSize = 0;
+        const byte* pRaw = getRawString(strIdxTable[pos] - 1, rawSize);
+        if (rawSize == destSize && memcmp(pRaw, pDest, destSize) == 0) {
+            return strIdxTable[pos] - 1;
         }
     }
     return -1; //没有匹配上.
 }
 
+const ResourcesParser::byte* ResourcesParser::ResStringPool::getRawString(uint32_t index, uint32_t& rawSize) const {
+    rawSize = 0;
+    if (index >= header.stringCount) {
+        return nullptr;
+    }
+    const byte* pStr = pStrings.get() + *(pOffsets.get() + index);
+    if (header.flags & ResStringPool_header::UTF8_FLAG) {
+        // 先是 utf16 字符数, 再是 utf8 字节数, 最高位为 1 时各占两个字节
+        pStr += (pStr[0] & 0x80) ? 2 : 1;
+        rawSize = pStr[0];
+        if (rawSize & 0x80) {
+            rawSize = ((rawSize & 0x7F) << 8) | pStr[1];
+            pStr += 2;
+        } else {
+            pStr += 1;
+        }
+    } else {
+        // utf16 字符数, 最高位为 1 时占两个 uint16_t
+        const uint16_t* pStr16 = (const uint16_t*)pStr;
+        rawSize = pStr16[0];
+        if (rawSize & 0x8000) {
+            rawSize = ((rawSize & 0x7FFF) << 16) | pStr16[1];
+            pStr16 += 2;
+        } else {
+            pStr16 += 1;
+        }
+        rawSize *= sizeof(uint16_t);
+        pStr = (const byte*)pStr16;
+    }
+    return pStr;
+}
+
+void ResourcesParser::ResStringPool::buildStrIdxTable() {
+    // 装载因子不超过 1/2, 容量取 2 的幂方便取模
+    uint32_t capacity = 16;
+    while (capacity < header.stringCount * 2) {
+        capacity <<= 1;
+    }
+    strIdxTable.assign(capacity, 0);
+    strIdxCount = 0;
+    for (uint32_t idx = 0; idx<header.stringCount; ++idx) {
+        insertStrIdx(idx);
+    }
+}
+
+void ResourcesParser::ResStringPool::insertStrIdx(uint32_t index) {
+    if ((strIdxCount + 1) * 2 > strIdxTable.size()) {
+        buildStrIdxTable();
+        return;
+    }
+    uint32_t rawSize = 0;
+    const byte* pRaw = getRawString(index, rawSize);
+    const uint32_t mask = strIdxTable.size() - 1;
+    uint32_t pos = hashRawString(pRaw, rawSize) & mask;
+    for (; strIdxTable[pos] != 0; pos = (pos + 1) & mask) {
+        uint32_t otherSize = 0;
+        const byte* pOther = getRawString(strIdxTable[pos] - 1, otherSize);
+        if (otherSize == rawSize && memcmp(pOther, pRaw, rawSize) == 0) {
+            // 重复的字符串和线性查找一样, 返回最小的 index
+            if (index + 1 < strIdxTable[pos]) {
+                strIdxTable[pos] = index + 1;
+            }
+            return;
+        }
+    }
+    strIdxTable[pos] = index + 1;
+    strIdxCount += 1;
+}
+
 uint32_t ResourcesParser::EntryPool::addNewEntry(uint16_t flags, uint32_t idxResKeyName, uint8_t dataType, uint32_t idxValue) {
-    uint32_t newEntryOffset = dataSize;
-    // update pOffsets
-    std::shared_ptr<uint32_t> pOffsetsNew = shared_ptr<uint32_t>(
-            new uint32_t[offsetCount+1],
-            default_delete<uint32_t[]>()
-    );
-    memcpy(pOffsetsNew.get(), pOffsets.get(), sizeof(uint32_t)*offsetCount);
-    memcpy(pOffsetsNew.get()+offsetCount, &newEntryOffset, sizeof(uint32_t));
-    pOffsets.swap(pOffsetsNew);
-    // update offsetCount
-    offsetCount += 1;
-
-    // update pData.
-    uint32_t newDataSize = dataSize + sizeof(ResTable_entry) + sizeof(Res_value);
-    std::shared_ptr<byte> pDataNew = shared_ptr<byte>(
-            new byte[newDataSize], 
-            default_delete<byte[]>()
-    );
-    memcpy(pDataNew.get(), pData.get(), dataSize);
-    ResTable_entry* pResTableEntry = (ResTable_entry*)(pDataNew.get()+dataSize);
-    pResTableEntry->size = 8;
-    pResTableEntry->flags = flags;
-    pResTableEntry->key.index = idxResKeyName;
-    Res_value* pResValue = (Res_value*)(pDataNew.get() + dataSize + sizeof(ResTable_entry));
-    pResValue->size = 8;
-    pResValue->res0 = 0;
-    pResValue->dataType = dataType;
-    pResValue->data = idxValue;
-    pData.swap(pDataNew);
-    //
-    dataSize = newDataSize;
+    NewEntry newEntry = { flags, idxResKeyName, dataType, idxValue };
+    return addNewEntries(std::vector<NewEntry>(1, newEntry));
+}
+
+// 容量不够时按翻倍增长, 解析出来的原始数据(容量为 0)第一次修改时整体拷贝一份
+void ResourcesParser::EntryPool::reserve(uint32_t newOffsetCount, uint32_t newDataSize) {
+    if (offsetCapacity < newOffsetCount) {
+        uint32_t capacity = std::max(newOffsetCount, offsetCapacity * 2);
+        std::shared_ptr<uint32_t> pOffsetsNew = shared_ptr<uint32_t>(
+                new uint32_t[capacity],
+                default_delete<uint32_t[]>()
+        );
+        if (offsetCount > 0) {
+            memcpy(pOffsetsNew.get(), pOffsets.get(), sizeof(uint32_t)*offsetCount);
+        }
+        pOffsets.swap(pOffsetsNew);
+        offsetCapacity = capacity;
+    }
+    if (dataCapacity < newDataSize) {
+        uint32_t capacity = std::max(newDataSize, dataCapacity * 2);
+        std::shared_ptr<byte> pDataNew = shared_ptr<byte>(
+                new byte[capacity], 
+                default_delete<byte[]>()
+        );
+        if (dataSize > 0) {
+            memcpy(pDataNew.get(), pData.get(), dataSize);
+        }
+        pData.swap(pDataNew);
+        dataCapacity = capacity;
+    }
+}
+
+uint32_t ResourcesParser::EntryPool::addNewEntries(const std::vector<NewEntry>& newEntries) {
+    if (newEntries.empty()) {
+        return 0;
+    }
+    const uint32_t entrySize = sizeof(ResTable_entry) + sizeof(Res_value);
+    const uint32_t addCount = newEntries.size();
+    reserve(offsetCount + addCount, dataSize + entrySize * addCount);
+
+    for (const NewEntry& newEntry : newEntries) {
+        // update pOffsets
+        *(pOffsets.get() + offsetCount) = dataSize;
+        offsetCount += 1;
+
+        // update pData.
+        ResTable_entry* pResTableEntry = (ResTable_entry*)(pData.get() + dataSize);
+        pResTableEntry->size = sizeof(ResTable_entry);
+        pResTableEntry->flags = newEntry.flags;
+        pResTableEntry->key.index = newEntry.idxResKeyName;
+        Res_value* pResValue = (Res_value*)(pData.get() + dataSize + sizeof(ResTable_entry));
+        pResValue->size = sizeof(Res_value);
+        pResValue->res0 = 0;
+        pResValue->dataType = newEntry.dataType;
+        pResValue->data = newEntry.idxValue;
+        dataSize += entrySize;
+    }
 
-    uint32_t uAddSize = sizeof(uint32_t) + sizeof(ResTable_entry) + sizeof(Res_value);
+    uint32_t uAddSize = (sizeof(uint32_t) + entrySize) * addCount;
     return uAddSize;
 }
 
 uint32_t ResourcesParser::ResTableType::addNewEntry(uint16_t flags, uint32_t idxResKeyName, uint8_t dataType, uint32_t idxValue) {
-    uint32_t uAddSizeEntryPool = entryPool.addNewEntry(flags, idxResKeyName, dataType, idxValue);
-    // update size and other info.
-    header.header.size += uAddSizeEntryPool;
-    header.entryCount += 1;
-    header.entriesStart += sizeof(uint32_t); //多了一个偏移
+    EntryPool::NewEntry newEntry = { flags, idxResKeyName, dataType, idxValue };
+    return addNewEntries(std::vector<EntryPool::NewEntry>(1, newEntry));
+}
 
-    //
-    uint32_t lastEntryOffset = *(entryPool.pOffsets.get() + (header.entryCount - 1));
-    ResTable_entry* pResTableEntry = ((ResTable_entry*)(entryPool.pData.get() + lastEntryOffset));
-    Res_value* pResValue = (Res_value*)((byte*)pResTableEntry + pResTableEntry->size);
+uint32_t ResourcesParser::ResTableType::makeDense() {
+    load();
+    if (!entryPool.isSparse && !entryPool.isOffset16) {
+        return 0;
+    }
+    isDirty = true;
+    // entries 已经是按 entry id 下标的, 直接按它重新生成 offset 数组
+    const uint32_t entryCount = entries.size();
+    std::shared_ptr<uint32_t> pOffsets(new uint32_t[std::max(entryCount, 1u)], default_delete<uint32_t[]>());
+    for (uint32_t i = 0; i < entryCount; ++i) {
+        pOffsets.get()[i] = entries[i] != nullptr
+            ? (uint32_t)((const byte*)entries[i] - entryPool.pData.get())
+            : (uint32_t)ResTable_type::NO_ENTRY;
+    }
+    // 按 chunk 里实际的布局算增量: 奇数个 16 位 offset 后面原来就有 2 字节填充. 数据区的起点保持 4 字节对齐
+    const uint32_t entriesStart = (header.header.headerSize + sizeof(uint32_t) * entryCount + 3) & ~3u;
+    const uint32_t addSize = std::max(entriesStart, (uint32_t)header.entriesStart) - header.entriesStart;
+    entryPool.pOffsets = pOffsets;
+    entryPool.offsetCount = entryCount;
+    entryPool.offsetCapacity = std::max(entryCount, 1u);
+    entryPool.isSparse = false;
+    entryPool.isOffset16 = false;
+
+    header.flags &= ~(ResTable_type::FLAG_SPARSE | ResTable_type::FLAG_OFFSET16);
+    header.entryCount = entryCount;
+    header.entriesStart += addSize;
+    header.header.size += addSize;
+    return addSize;
+}
 
-    entries.push_back(pResTableEntry);
-    values.push_back(pResValue);
+void ResourcesParser::ResTableType::makeWritable() {
+    load();
+    if (entryPool.dataCapacity > 0) {
+        return;
+    }
+    const uint32_t capacity = std::max(entryPool.dataSize, 1u);
+    std::shared_ptr<byte> pData(new byte[capacity], default_delete<byte[]>());
+    memcpy(pData.get(), entryPool.pData.get(), entryPool.dataSize);
+    for (uint32_t idx = 0; idx < entries.size(); ++idx) {
+        if (entries[idx] != nullptr) {
+            entries[idx] = (ResTable_entry*)(pData.get() + ((const byte*)entries[idx] - entryPool.pData.get()));
+            values[idx] = getValueFromEntry(entries[idx]);
+        }
+    }
+    entryPool.pData = pData;
+    entryPool.dataCapacity = capacity;
+}
 
-    return uAddSizeEntryPool;
+uint32_t ResourcesParser::ResTableType::addNewEntries(const std::vector<EntryPool::NewEntry>& newEntries) {
+    load();
+    isDirty = true;
+    // 追加只支持稠密的 offset 数组
+    const uint32_t uAddSizeDense = makeDense();
+    const byte* pDataOld = entryPool.pData.get();
+    uint32_t uAddSizeEntryPool = entryPool.addNewEntries(newEntries);
+    // update size and other info.
+    header.header.size += uAddSizeEntryPool;
+    header.entryCount += newEntries.size();
+    header.entriesStart += sizeof(uint32_t) * newEntries.size(); //多了偏移
+
+    // 数据区换了地址的话, entries/values 里已有的指针要重新指过去
+    if (entryPool.pData.get() != pDataOld) {
+        for (uint32_t idx = 0; idx<entries.size(); ++idx) {
+            entries[idx] = getEntryFromEntryPool(entryPool, idx);
+            values[idx] = entries[idx] != nullptr ? getValueFromEntry(entries[idx]) : nullptr;
+        }
+    }
+    entries.reserve(header.entryCount);
+    values.reserve(header.entryCount);
+    for (uint32_t idx = entries.size(); idx<header.entryCount; ++idx) {
+        ResTable_entry* pResTableEntry = getEntryFromEntryPool(entryPool, idx);
+        entries.push_back(pResTableEntry);
+        values.push_back(getValueFromEntry(pResTableEntry));
+    }
+
+    return uAddSizeDense + uAddSizeEntryPool;
 }
 
 uint32_t ResourcesParser::addResKeyStr(std::string pkgName, std::string resType, std::string resKeyStr) {
@@ -743,6 +1312,7 @@ uint32_t ResourcesParser::addResKeyStr(std::string pkgName, std::string resType,
         return 0;
     }
     ResTableType* pResTableType = vecResTableTypePtr[0].get();
+    pResTableType->load();
 
     // add new res entry info to res table.
     uint32_t uAddSizeNewEntry = pResTableType->addNewEntry(0x00, newResNameIdx, Res_value::TYPE_STRING, newDestValueIdx);
@@ -752,139 +1322,620 @@ uint32_t ResourcesParser::addResKeyStr(std::string pkgName, std::string resType,
     //
     uint32_t newEntryIdx = pResTableType->entries.size() - 1;
     uint32_t newResId = 0x7f000000 | ((0x000000FF&idType)<<16) | (0x0000FFFF&newEntryIdx);
+    invalidateTypeIndex(newResId);
     return newResId;
 }
 
-bool ResourcesParser::saveToFile(const std::string& destFName) {
-    FILE* pFile = fopen(destFName.c_str(), "w+");
-    if (pFile == nullptr) {
-       cout<<"pFile == nullptr, exit"<<endl;
+static bool pwriteAll(int fd, const ResourcesParser::byte* pData, uint32_t len, uint32_t offset) {
+    uint32_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, pData + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+// 一个 type chunk 写出去的布局
+struct TypeSaveLayout {
+    bool isSparse;
+    bool isOffset16;
+    uint32_t offsetCount;
+    uint32_t headerSize;
+    uint32_t entriesStart;
+    uint32_t dataSize;
+    uint32_t size;
+    // SAVE_DEDUP 去重之后每个 entry id 在数据区里的 offset, 和要从原数据区拷贝的每份 entry 数据.
+    // 为空表示数据区原样写出
+    struct EntryCopy {
+        uint32_t sourceOffset;
+        uint32_t size;
+        uint32_t offset;
+    };
+    std::vector<uint32_t> offsets;
+    std::vector<EntryCopy> copies;
+};
+
+// entry id 写出去时在数据区里的 offset, 没有这个 entry 返回 NO_ENTRY
+static uint32_t getEntrySaveOffset(
+        const ResourcesParser::ResTableType* pResTable, const TypeSaveLayout& layout, uint32_t entryId) {
+    if (!layout.offsets.empty()) {
+        return layout.offsets[entryId];
+    }
+    const ResTable_entry* pEntry = pResTable->entries[entryId];
+    return pEntry != nullptr
+        ? (uint32_t)((const ResourcesParser::byte*)pEntry - pResTable->entryPool.pData.get())
+        : (uint32_t)ResTable_type::NO_ENTRY;
+}
+
+// 稀疏编码时 entry 的个数; 稀疏编码不比稠密的小, 或者 offset 超出 16 位(按 4 字节计)放不下时返回 -1
+static uint32_t getSparseEntryCount(const ResourcesParser::ResTableType* pResTable, const TypeSaveLayout& layout) {
+    const uint32_t entryCount = pResTable->entries.size();
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < entryCount; ++i) {
+        const uint32_t offset = getEntrySaveOffset(pResTable, layout, i);
+        if (offset == ResTable_type::NO_ENTRY) {
+            continue;
+        }
+        if (offset % 4 != 0 || offset / 4 > 0xFFFF) {
+            return (uint32_t)-1;
+        }
+        ++count;
+    }
+    return count < entryCount ? count : (uint32_t)-1;
+}
+
+// 所有 offset 都能用 16 位(按 4 字节计, 0xFFFF 留给 NO_ENTRY16)表示
+static bool canUseOffset16(const ResourcesParser::ResTableType* pResTable, const TypeSaveLayout& layout) {
+    for (uint32_t i = 0; i < pResTable->entries.size(); ++i) {
+        const uint32_t offset = getEntrySaveOffset(pResTable, layout, i);
+        if (offset != ResTable_type::NO_ENTRY
+                && (offset % 4 != 0 || offset / 4 >= ResourcesParser::EntryPool::NO_ENTRY16)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 按原数据区里的顺序给每份 entry 数据哈希, 字节相同的只保留第一份, 各自 4 字节对齐.
+// 返回去重后数据区的大小, 不比原来小时清空 offsets/copies 并返回原来的大小
+// 共用的是整个 ResTable_entry, key 也在里面, 所以只有 key 和值都相同的 entry 才能合并.
+// aapt 生成的表同一个 type chunk 里 key 各不相同, 这里什么都省不下
+static uint32_t dedupEntries(const ResourcesParser::ResTableType* pResTable, TypeSaveLayout& layout) {
+    const ResourcesParser::byte* pData = pResTable->entryPool.pData.get();
+    const uint32_t entryCount = pResTable->entries.size();
+    // (原 offset, entry id), 原来就共用一份数据的 entry id 排在一起
+    std::vector<std::pair<uint32_t, uint32_t> > order;
+    order.reserve(entryCount);
+    for (uint32_t i = 0; i < entryCount; ++i) {
+        if (pResTable->entries[i] != nullptr) {
+            order.push_back(std::make_pair((uint32_t)((const ResourcesParser::byte*)pResTable->entries[i] - pData), i));
+        }
+    }
+    std::sort(order.begin(), order.end());
+
+    layout.offsets.assign(entryCount, ResTable_type::NO_ENTRY);
+    layout.copies.clear();
+    // 哈希 -> copies 的下标
+    std::unordered_multimap<uint32_t, uint32_t> written;
+    uint32_t dataSize = 0;
+    uint32_t lastSource = ResTable_type::NO_ENTRY;
+    uint32_t lastOffset = 0;
+    for (const auto& item : order) {
+        if (item.first == lastSource) {
+            layout.offsets[item.second] = lastOffset;
+            continue;
+        }
+        const uint32_t size = ResourcesParser::getEntrySize(pResTable->entries[item.second]);
+        const uint32_t hash = hashRawString(pData + item.first, size);
+        uint32_t offset = ResTable_type::NO_ENTRY;
+        auto range = written.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            const TypeSaveLayout::EntryCopy& copy = layout.copies[it->second];
+            if (copy.size == size && memcmp(pData + copy.sourceOffset, pData + item.first, size) == 0) {
+                offset = copy.offset;
+                break;
+            }
+        }
+        if (offset == ResTable_type::NO_ENTRY) {
+            offset = (dataSize + 3) & ~3u;
+            written.insert(std::make_pair(hash, (uint32_t)layout.copies.size()));
+            TypeSaveLayout::EntryCopy copy = { item.first, size, offset };
+            layout.copies.push_back(copy);
+            dataSize = offset + size;
+        }
+        layout.offsets[item.second] = offset;
+        lastSource = item.first;
+        lastOffset = offset;
+    }
+
+    if (dataSize >= pResTable->entryPool.dataSize) {
+        layout.offsets.clear();
+        layout.copies.clear();
+        return pResTable->entryPool.dataSize;
+    }
+    return dataSize;
+}
+
+static TypeSaveLayout getTypeSaveLayout(ResourcesParser::ResTableType* pResTable, uint32_t flags) {
+    pResTable->load();
+    const ResTable_type& header = pResTable->header;
+    const ResourcesParser::EntryPool& pool = pResTable->entryPool;
+
+    TypeSaveLayout layout;
+    layout.dataSize = (flags & ResourcesParser::SAVE_DEDUP) ? dedupEntries(pResTable, layout) : pool.dataSize;
+    // 原来就是稀疏编码的保持不变, 否则按 flags 选
+    const uint32_t sparseCount = pool.isSparse
+        ? pool.offsetCount
+        : (flags & ResourcesParser::SAVE_SPARSE) ? getSparseEntryCount(pResTable, layout) : (uint32_t)-1;
+    layout.isSparse = sparseCount != (uint32_t)-1;
+    // 原来就是 16 位 offset 的, 或者 flags 要求的, 放得下就用 16 位
+    layout.isOffset16 = !pool.isSparse
+        && (pool.isOffset16 || (flags & ResourcesParser::SAVE_OFFSET16))
+        && canUseOffset16(pResTable, layout);
+    // 两种都能用时选 offset 数组小的
+    if (layout.isSparse && layout.isOffset16) {
+        if (sizeof(uint16_t) * header.entryCount <= sizeof(uint32_t) * sparseCount) {
+            layout.isSparse = false;
+        } else {
+            layout.isOffset16 = false;
+        }
+    }
+    layout.offsetCount = layout.isSparse ? sparseCount : header.entryCount;
+    // 写出去的 header 至少是完整的 ResTable_type, 原来更长的部分照抄
+    layout.headerSize = std::max<uint32_t>(header.header.headerSize, sizeof(ResTable_type));
+    // 编码没变的话保留 offset 数组之后原有的空隙. 16 位的 offset 数组后面补齐到 4 字节
+    const uint32_t offsetsSize = (layout.isOffset16 ? sizeof(uint16_t) : sizeof(uint32_t)) * layout.offsetCount;
+    const uint32_t entriesStart = (layout.headerSize + offsetsSize + 3) & ~3u;
+    layout.entriesStart = layout.isSparse == pool.isSparse && layout.isOffset16 == pool.isOffset16
+        ? std::max<uint32_t>(header.entriesStart, entriesStart)
+        : entriesStart;
+    layout.size = layout.entriesStart + layout.dataSize;
+    return layout;
+}
+
+bool ResourcesParser::saveToFile(const std::string& destFName, bool sync, int jobCount, uint32_t flags) {
+    vector<SaveChunk> chunks;
+    ResTable_header fileHeader;
+    vector<ResTable_package> packageHeaders;
+    uint32_t dedupSaved = 0;
+    const uint32_t size = planSave(chunks, fileHeader, packageHeaders, flags, &dedupSaved);
+    if (flags & SAVE_DEDUP) {
+        cout<<"dedup saved "<<dedupSaved<<" bytes of entry data"<<endl;
+    }
+
+    // 目标就是源文件的话, 截断之后就拷贝不到原来的 chunk 了
+    const bool overwriteSource = mFile != nullptr && mFile->isSameFile(destFName);
+    const std::string writeName = overwriteSource ? destFName + ".tmp" : destFName;
+    int fd = open(writeName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+       cout<<"can't open "<<writeName<<": "<<strerror(errno)<<endl;
        return false;
     }
+    bool ok = ftruncate(fd, size) == 0 && writeSaveChunks(fd, chunks, jobCount, flags);
+    if (!ok) {
+        cout<<"write "<<writeName<<" failed: "<<strerror(errno)<<endl;
+    } else if (sync && fsync(fd) != 0) {
+        cout<<"fsync "<<writeName<<" failed: "<<strerror(errno)<<endl;
+        ok = false;
+    }
+    ok = close(fd) == 0 && ok;
+    if (overwriteSource) {
+        ok = ok && rename(writeName.c_str(), destFName.c_str()) == 0;
+        if (!ok) {
+            unlink(writeName.c_str());
+        }
+    }
+    return ok;
+}
+
+bool ResourcesParser::canCopyResTableType(const ResTableType* pResTable, uint32_t flags) const {
+    // 要换编码或者去重的话得先解析出来看看
+    return mFile != nullptr
+        && pResTable->pSource == mFile
+        && !pResTable->isDirty
+        && !(flags & (SAVE_SPARSE | SAVE_DEDUP | SAVE_OFFSET16));
+}
+
+bool ResourcesParser::canCopyPackage(const PackageResource* pPkgRes, uint32_t flags) const {
+    if (mFile == nullptr || pPkgRes->isDirty || pPkgRes->pTypes->isDirty || pPkgRes->pKeys->isDirty) {
+        return false;
+    }
+    for (const ChunkInfo& chunk : pPkgRes->chunks) {
+        if (chunk.pResTableType != nullptr
+                ? !canCopyResTableType(chunk.pResTableType.get(), flags)
+                : chunk.pResTableUnknown->isDirty) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t ResourcesParser::planSave(
+        vector<SaveChunk>& chunks,
+        ResTable_header& fileHeader,
+        vector<ResTable_package>& packageHeaders,
+        uint32_t flags,
+        uint32_t* pDedupSaved) {
+    // 没有源文件时全部重新编码
+    const bool hasSource = mFile != nullptr;
+    uint32_t offset = 0;
+    uint32_t dedupSaved = 0;
+    auto addChunk = [&chunks, &offset](uint32_t size, int64_t sourceOffset, const byte* pHeader,
+            ResStringPool* pStringPool, ResTableType* pResTableType, ResTableTypeUnknown* pResTableUnknown) {
+        // 在源文件里紧挨着的两段拷贝合成一段
+        if (sourceOffset >= 0 && !chunks.empty() && chunks.back().sourceOffset >= 0
+                && chunks.back().sourceOffset + chunks.back().size == sourceOffset) {
+            chunks.back().size += size;
+        } else {
+            SaveChunk chunk = { offset, size, sourceOffset, pHeader, pStringPool, pResTableType, pResTableUnknown };
+            chunks.push_back(chunk);
+        }
+        offset += size;
+    };
+    auto addStringPool = [&](ResStringPool* pStringPool) {
+        if (hasSource && !pStringPool->isDirty) {
+            addChunk(pStringPool->header.header.size, pStringPool->chunkOffset, nullptr, nullptr, nullptr, nullptr);
+        } else {
+            addChunk(getStringPoolSaveSize(pStringPool), -1, nullptr, pStringPool, nullptr, nullptr);
+        }
+    };
+
+    fileHeader = mResourcesInfo;
+    addChunk(sizeof(ResTable_header), -1, (const byte*)&fileHeader, nullptr, nullptr, nullptr);
+    addStringPool(mGlobalStringPool.get());
+
+    // 预留好空间, push_back 不会让前面 chunk 里的 pHeader 失效
+    packageHeaders.reserve(mResourceForPackageName.size());
+    for (auto &item : mResourceForPackageName) {
+        PackageResource* pPkgRes = item.second.get();
+        if (canCopyPackage(pPkgRes, flags)) {
+            addChunk(pPkgRes->header.header.size, pPkgRes->chunkOffset, nullptr, nullptr, nullptr, nullptr);
+            continue;
+        }
+
+        // 改过的 package 只重新写 header, 其余 chunk 各自判断
+        const uint32_t packageStart = offset;
+        packageHeaders.push_back(pPkgRes->header);
+        addChunk(sizeof(ResTable_package), -1, (const byte*)&packageHeaders.back(), nullptr, nullptr, nullptr);
+        addStringPool(pPkgRes->pTypes.get());
+        addStringPool(pPkgRes->pKeys.get());
+        for (const ChunkInfo& chunk : pPkgRes->chunks) {
+            if (chunk.pResTableType != nullptr) {
+                ResTableType* pResTable = chunk.pResTableType.get();
+                if (canCopyResTableType(pResTable, flags)) {
+                    addChunk(pResTable->header.header.size, pResTable->chunkOffset, nullptr, nullptr, nullptr, nullptr);
+                } else {
+                    const TypeSaveLayout layout = getTypeSaveLayout(pResTable, flags);
+                    dedupSaved += pResTable->entryPool.dataSize - layout.dataSize;
+                    addChunk(layout.size, -1, nullptr, nullptr, pResTable, nullptr);
+                }
+            } else {
+                ResTableTypeUnknown* pResTableUnknown = chunk.pResTableUnknown.get();
+                const uint32_t size = ((ResChunk_header*)pResTableUnknown->pChunkAllData.get())->size;
+                if (hasSource && !pResTableUnknown->isDirty) {
+                    addChunk(size, chunk.offset, nullptr, nullptr, nullptr, nullptr);
+                } else {
+                    addChunk(size, -1, nullptr, nullptr, nullptr, pResTableUnknown);
+                }
+            }
+        }
+        packageHeaders.back().header.size = offset - packageStart;
+    }
+    fileHeader.header.size = offset;
+    if (pDedupSaved != nullptr) {
+        *pDedupSaved = dedupSaved;
+    }
+    return offset;
+}
+
+bool ResourcesParser::writeSaveChunks(int fd, const vector<SaveChunk>& chunks, int jobCount, uint32_t flags) const {
+    if (jobCount <= 0) {
+        jobCount = thread::hardware_concurrency();
+    }
+    jobCount = std::max(1, std::min<int>(jobCount, chunks.size()));
+
+    if (jobCount == 1) {
+        vector<byte> buf;
+        for (size_t i = 0; i < chunks.size(); ) {
+            if (chunks[i].sourceOffset >= 0) {
+                if (!mFile->copyTo(fd, chunks[i].sourceOffset, chunks[i].size, chunks[i].offset)) {
+                    return false;
+                }
+                ++i;
+                continue;
+            }
+            // 连续的要编码的 chunk 编码进同一块缓冲区, 一次写
+            size_t end = i;
+            uint32_t runSize = 0;
+            for (; end < chunks.size() && chunks[end].sourceOffset < 0; ++end) {
+                runSize += chunks[end].size;
+            }
+            buf.resize(runSize);
+            for (size_t k = i; k < end; ++k) {
+                if (writeSaveChunk(buf.data() + chunks[k].offset - chunks[i].offset, chunks[k], flags) != chunks[k].size) {
+                    return false;
+                }
+            }
+            if (!pwriteAll(fd, buf.data(), runSize, chunks[i].offset)) {
+                return false;
+            }
+            i = end;
+        }
+        return true;
+    }
+
+    // 大的 chunk 先开始, 线程之间的负载更均匀
+    vector<size_t> order(chunks.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&chunks](size_t a, size_t b) {
+        return chunks[a].size > chunks[b].size;
+    });
+
+    atomic<size_t> next(0);
+    atomic<bool> failed(false);
+    auto worker = [&]() {
+        // 每个线程一块编码缓冲区, 按需要变大
+        vector<byte> buf;
+        for (size_t idx = next++; idx < order.size() && !failed; idx = next++) {
+            const SaveChunk& chunk = chunks[order[idx]];
+            bool ok = false;
+            if (chunk.sourceOffset >= 0) {
+                ok = mFile->copyTo(fd, chunk.sourceOffset, chunk.size, chunk.offset);
+            } else {
+                if (buf.size() < chunk.size) {
+                    buf.resize(chunk.size);
+                }
+                ok = writeSaveChunk(buf.data(), chunk, flags) == chunk.size
+                    && pwriteAll(fd, buf.data(), chunk.size, chunk.offset);
+            }
+            if (!ok) {
+                failed = true;
+            }
+        }
+    };
+    vector<thread> workers;
+    for (int i = 1; i < jobCount; ++i) {
+        workers.push_back(thread(worker));
+    }
+    worker();
+    for (thread& item : workers) {
+        item.join();
+    }
+    return !failed;
+}
+
+uint32_t ResourcesParser::writeSaveChunk(byte* pDest, const SaveChunk& chunk, uint32_t flags) {
+    if (chunk.pHeader != nullptr) {
+        memcpy(pDest, chunk.pHeader, chunk.size);
+        return chunk.size;
+    } else if (chunk.pStringPool != nullptr) {
+        return writeStringPool(pDest, chunk.pStringPool);
+    } else if (chunk.pResTableType != nullptr) {
+        return writeResTableType(pDest, chunk.pResTableType, flags);
+    }
+    return writeResTableUnknown(pDest, chunk.pResTableUnknown);
+}
+
+uint32_t ResourcesParser::getSaveSize(uint32_t flags) {
+    uint32_t size = sizeof(ResTable_header) + getStringPoolSaveSize(mGlobalStringPool.get());
+    for (auto &item : mResourceForPackageName) {
+        size += getPackageSaveSize(item.second.get(), flags);
+    }
+    return size;
+}
+
+uint32_t ResourcesParser::writeTo(byte* pDest, uint32_t flags) {
+    byte* pCur = pDest;
 
     // 写 ResTable_header
-    fwrite(&(mResourcesInfo), sizeof(ResTable_header), 1, pFile);
+    memcpy(pCur, &mResourcesInfo, sizeof(ResTable_header));
+    pCur += sizeof(ResTable_header);
 
     // 写 Global String Pool
-    writeStringPool(pFile, mGlobalStringPool.get());
+    pCur += writeStringPool(pCur, mGlobalStringPool.get());
 
     // 写 Table Package
     for (auto &item : mResourceForPackageName) {
-        writePackageResource(pFile, item.second.get());
+        pCur += writePackageResource(pCur, item.second.get(), flags);
     }
 
+    const uint32_t size = pCur - pDest;
+    ((ResChunk_header*)pDest)->size = size;
+    return size;
+}
 
-    fclose( pFile );
-    return true;
+// 字符串数组(含末尾对齐填充)和 style 数组的大小
+static uint32_t getStringsBufSize(const ResStringPool_header& header) {
+    if (header.stringCount == 0) {
+        return 0;
+    }
+    return header.styleCount > 0
+        ? header.stylesStart - header.stringsStart
+        : header.header.size - header.stringsStart;
+}
+
+static uint32_t getStylesBufSize(const ResStringPool_header& header) {
+    return header.styleCount > 0 ? header.header.size - header.stylesStart : 0;
 }
 
-void ResourcesParser::writeStringPool(FILE* pFile, ResStringPool* pStringPool) {
-   //
-    int32_t uCur = ftell(pFile);
-    cout<<"[write][StringPool] start: 0x"<<hex<<uCur<<dec<<endl;
-   
+uint32_t ResourcesParser::getStringPoolSaveSize(const ResStringPool* pStringPool) {
+    const ResStringPool_header& header = pStringPool->header;
+    return sizeof(ResStringPool_header)
+        + sizeof(uint32_t) * (header.stringCount + header.styleCount)
+        + getStringsBufSize(header)
+        + getStylesBufSize(header);
+}
+
+uint32_t ResourcesParser::getPackageSaveSize(PackageResource* pPkgRes, uint32_t flags) {
+    if (pPkgRes == nullptr) {
+        return 0;
+    }
+    uint32_t size = sizeof(ResTable_package)
+        + getStringPoolSaveSize(pPkgRes->pTypes.get())
+        + getStringPoolSaveSize(pPkgRes->pKeys.get());
+    for (const ChunkInfo& chunk : pPkgRes->chunks) {
+        if (chunk.pResTableType != nullptr) {
+            size += getResTableTypeSaveSize(chunk.pResTableType.get(), flags);
+        } else {
+            size += ((ResChunk_header*)chunk.pResTableUnknown->pChunkAllData.get())->size;
+        }
+    }
+    return size;
+}
+
+uint32_t ResourcesParser::getResTableTypeSaveSize(ResTableType* pResTable, uint32_t flags) {
+    return getTypeSaveLayout(pResTable, flags).size;
+}
+
+uint32_t ResourcesParser::writeStringPool(byte* pDest, const ResStringPool* pStringPool) {
+    const ResStringPool_header& header = pStringPool->header;
+    byte* pCur = pDest;
+
     // write ResStringPool_header
-    fwrite(&(pStringPool->header), sizeof(ResStringPool_header), 1, pFile);
+    memcpy(pCur, &header, sizeof(ResStringPool_header));
+    pCur += sizeof(ResStringPool_header);
 
     // write String offset array
-    if (pStringPool->header.stringCount > 0) {
-        const uint32_t sizeStrOffset = sizeof(uint32_t) * pStringPool->header.stringCount;
-        fwrite(pStringPool->pOffsets.get(), 1, sizeStrOffset, pFile);
+    if (header.stringCount > 0) {
+        const uint32_t sizeStrOffset = sizeof(uint32_t) * header.stringCount;
+        memcpy(pCur, pStringPool->pOffsets.get(), sizeStrOffset);
+        pCur += sizeStrOffset;
     }
     //
-    if (pStringPool->header.styleCount > 0) {
-        const uint32_t sizeStyleOffset = sizeof(uint32_t) * pStringPool->header.styleCount;
-        fwrite(pStringPool->pStyleOffsets.get(), 1, sizeStyleOffset, pFile);
+    if (header.styleCount > 0) {
+        const uint32_t sizeStyleOffset = sizeof(uint32_t) * header.styleCount;
+        memcpy(pCur, pStringPool->pStyleOffsets.get(), sizeStyleOffset);
+        pCur += sizeStyleOffset;
     }
+
     // write string array.
-    if (pStringPool->header.stringCount > 0) {
-        const uint32_t strBufSize = pStringPool->header.styleCount > 0
-            ? pStringPool->header.stylesStart - pStringPool->header.stringsStart
-            : pStringPool->header.header.size - pStringPool->header.stringsStart;
-        fwrite(pStringPool->pStrings.get(), 1, strBufSize, pFile);
+    if (header.stringCount > 0) {
+        const uint32_t strBufSize = getStringsBufSize(header);
+        memcpy(pCur, pStringPool->pStrings.get(), strBufSize);
+        pCur += strBufSize;
     }
+
     // write style array.
-    if (pStringPool->header.styleCount > 0) {
-        const uint32_t styleBufSize = pStringPool->header.header.size - pStringPool->header.stylesStart;
-        fwrite(pStringPool->pStyles.get(), 1, styleBufSize, pFile);
+    if (header.styleCount > 0) {
+        const uint32_t styleBufSize = getStylesBufSize(header);
+        memcpy(pCur, pStringPool->pStyles.get(), styleBufSize);
+        pCur += styleBufSize;
     }
 
+    return pCur - pDest;
 }
 
-
-void ResourcesParser::writePackageResource(FILE* pFile, PackageResource* pPkgRes) {
+uint32_t ResourcesParser::writePackageResource(byte* pDest, PackageResource* pPkgRes, uint32_t flags) {
     if (pPkgRes == nullptr) {
-        return;
+        return 0;
     }
+    byte* pCur = pDest;
+
     // write ResTable_package
-    fwrite(&(pPkgRes->header), sizeof(ResTable_package), 1, pFile);
+    memcpy(pCur, &pPkgRes->header, sizeof(ResTable_package));
+    pCur += sizeof(ResTable_package);
 
     // write ResType string pool
-    writeStringPool(pFile, pPkgRes->pTypes.get());
+    pCur += writeStringPool(pCur, pPkgRes->pTypes.get());
 
     // write ResName string pool
-    writeStringPool(pFile, pPkgRes->pKeys.get());
-
-    //
-    for (auto &itemResTableUnknownPtr : pPkgRes->vecResTableUnknownPtrs) {
-        writeResTableUnknown(pFile, itemResTableUnknownPtr.get());
-    }
-
-    //
-    for (auto &itemKV : pPkgRes->resTablePtrs) {
-        std::vector<ResourcesParser::ResTableTypePtr>& vectorResTable = itemKV.second;
-        for (auto resTableItem : vectorResTable) {
-            switch(resTableItem->header.header.type) {
-                case RES_TABLE_TYPE_TYPE: {
-                    writeResTableType(pFile, resTableItem.get());
-                } break;
-                default:
-                break;
-            }
+    pCur += writeStringPool(pCur, pPkgRes->pKeys.get());
+
+    // 其余 chunk 按原来在文件里的顺序写
+    for (const ChunkInfo& chunk : pPkgRes->chunks) {
+        if (chunk.pResTableType != nullptr) {
+            pCur += writeResTableType(pCur, chunk.pResTableType.get(), flags);
+        } else {
+            pCur += writeResTableUnknown(pCur, chunk.pResTableUnknown.get());
         }
     }
-}
 
-void ResourcesParser::writeResTableType(FILE* pFile, ResTableType* pResTable) {
-    if (pFile == nullptr || pResTable == nullptr) {
-        return;
-    }
-    //
-    fwrite(&(pResTable->header), sizeof(ResTable_type), 1, pFile);
+    const uint32_t size = pCur - pDest;
+    ((ResChunk_header*)pDest)->size = size;
+    return size;
+}
 
-    // fill 28 space.
-    uint32_t seek = pResTable->header.header.headerSize - sizeof(ResTable_type);
-    if (seek > 0) {
-        unsigned char* pBufTmp = new unsigned char[seek];
-        memset(pBufTmp, 0, seek);
-        fwrite(&pBufTmp, 1, seek, pFile);
-        delete []pBufTmp;
-        pBufTmp = nullptr;
+uint32_t ResourcesParser::writeResTableType(byte* pDest, ResTableType* pResTable, uint32_t flags) {
+    const TypeSaveLayout layout = getTypeSaveLayout(pResTable, flags);
+    const ResTable_type& header = pResTable->header;
+    const EntryPool& pool = pResTable->entryPool;
+
+    // offset 数组之后到 entriesStart 的空隙填 0
+    memset(pDest, 0, layout.entriesStart);
+    memcpy(pDest, &header, sizeof(ResTable_type));
+    // 比 ResTable_type 长的 header(更新版本的 config 字段)从原文件里照抄, 没有原文件的填 0
+    if (pResTable->pSource != nullptr && header.header.headerSize > sizeof(ResTable_type)) {
+        pResTable->pSource->read(
+            pResTable->chunkOffset + sizeof(ResTable_type),
+            pDest + sizeof(ResTable_type),
+            header.header.headerSize - sizeof(ResTable_type));
     }
 
     // write entry offset array.
-    const uint32_t sizeEntryOffset = sizeof(uint32_t) * pResTable->header.entryCount;
-    fwrite(pResTable->entryPool.pOffsets.get(), sizeof(uint32_t), pResTable->header.entryCount, pFile);
+    if (layout.isSparse == pool.isSparse && layout.isOffset16 == pool.isOffset16 && layout.offsets.empty()) {
+        const uint32_t offsetsSize = (layout.isOffset16 ? sizeof(uint16_t) : sizeof(uint32_t)) * layout.offsetCount;
+        memcpy(pDest + layout.headerSize, pool.pOffsets.get(), offsetsSize);
+    } else if (layout.isSparse) {
+        // 按 entry id 顺序写 (id, offset / 4)
+        ResTable_sparseTypeEntry* pSparse = (ResTable_sparseTypeEntry*)(pDest + layout.headerSize);
+        for (uint32_t i = 0; i < pResTable->entries.size(); ++i) {
+            const uint32_t offset = getEntrySaveOffset(pResTable, layout, i);
+            if (offset != ResTable_type::NO_ENTRY) {
+                pSparse->idx = i;
+                pSparse->offset = offset / 4;
+                ++pSparse;
+            }
+        }
+    } else if (layout.isOffset16) {
+        uint16_t* pOffsets = (uint16_t*)(pDest + layout.headerSize);
+        for (uint32_t i = 0; i < layout.offsetCount; ++i) {
+            const uint32_t offset = getEntrySaveOffset(pResTable, layout, i);
+            pOffsets[i] = offset != ResTable_type::NO_ENTRY ? offset / 4 : EntryPool::NO_ENTRY16;
+        }
+    } else {
+        uint32_t* pOffsets = (uint32_t*)(pDest + layout.headerSize);
+        for (uint32_t i = 0; i < layout.offsetCount; ++i) {
+            pOffsets[i] = getEntrySaveOffset(pResTable, layout, i);
+        }
+    }
 
-    // fill space to dataStart
-    const uint32_t sizeFill2DataStart = pResTable->header.entriesStart - pResTable->header.header.headerSize - sizeEntryOffset;
-    if (sizeFill2DataStart > 0) {
-        unsigned char* pBufTmp = new unsigned char[sizeFill2DataStart];
-        memset(pBufTmp, 0, sizeFill2DataStart);
-        fwrite(pBufTmp, 1, sizeFill2DataStart, pFile);
-        delete []pBufTmp;
-        pBufTmp = nullptr;
+    // write entry data. 去重过的每份数据只写一次, 对齐的空隙填 0
+    if (layout.offsets.empty()) {
+        memcpy(pDest + layout.entriesStart, pool.pData.get(), pool.dataSize);
+    } else {
+        memset(pDest + layout.entriesStart, 0, layout.dataSize);
+        for (const TypeSaveLayout::EntryCopy& copy : layout.copies) {
+            memcpy(pDest + layout.entriesStart + copy.offset, pool.pData.get() + copy.sourceOffset, copy.size);
+        }
     }
 
-    // write
-    fwrite(pResTable->entryPool.pData.get(), 1, pResTable->entryPool.dataSize, pFile);
+    ResTable_type* pHeader = (ResTable_type*)pDest;
+    pHeader->header.headerSize = layout.headerSize;
+    pHeader->header.size = layout.size;
+    pHeader->entryCount = layout.offsetCount;
+    pHeader->entriesStart = layout.entriesStart;
+    pHeader->flags &= ~(ResTable_type::FLAG_SPARSE | ResTable_type::FLAG_OFFSET16);
+    if (layout.isSparse) {
+        pHeader->flags |= ResTable_type::FLAG_SPARSE;
+    } else if (layout.isOffset16) {
+        pHeader->flags |= ResTable_type::FLAG_OFFSET16;
+    }
+    return layout.size;
 }
 
-void ResourcesParser::writeResTableUnknown(FILE* pFile, ResTableTypeUnknown* pResTableUnknown) {
-    ResChunk_header* pChunkHeader = (ResChunk_header*)pResTableUnknown->pChunkAllData.get();
-
-    fwrite(pResTableUnknown->pChunkAllData.get(), 1, pChunkHeader->size, pFile);
+uint32_t ResourcesParser::writeResTableUnknown(byte* pDest, const ResTableTypeUnknown* pResTableUnknown) {
+    const ResChunk_header* pChunkHeader = (const ResChunk_header*)pResTableUnknown->pChunkAllData.get();
 
+    memcpy(pDest, pResTableUnknown->pChunkAllData.get(), pChunkHeader->size);
+    return pChunkHeader->size;
 }
 
 
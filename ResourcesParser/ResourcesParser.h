@@ -2,17 +2,20 @@
 #define RESOURCES_PARSER_H
 
 #include "ResourceTypes.h"
+#include "ResourcesFile.h"
 
 #include <string>
 #include <list>
 #include <map>
+#include <unordered_map>
 #include <vector>
-#include <fstream>
 #include <memory>
 
 #define TYPE_ID(X) ((X & 0x00FF0000) >> 16)
 #define ENTRY_ID(X) (X & 0xFFFF)
 
+class ResourcesIndex;
+
 class ResourcesParser {
 public:
 	typedef unsigned char byte;
@@ -22,7 +25,38 @@ public:
 		std::shared_ptr<byte> pData;
 		uint32_t dataSize;
 		uint32_t offsetCount;
+
+		// 可增长缓冲区的容量, 为 0 表示还指向解析出来的原始数据
+		uint32_t offsetCapacity;
+		uint32_t dataCapacity;
+
+		// FLAG_SPARSE 的 type chunk: pOffsets 里是按 entry id 排好序的 ResTable_sparseTypeEntry,
+		// offsetCount 是它的个数
+		bool isSparse;
+		// FLAG_OFFSET16 的 type chunk: pOffsets 里实际是 offsetCount 个 uint16_t(按 4 字节计,
+		// NO_ENTRY16 表示没有), 直接指向解析出来的数据, 不展开成 32 位
+		bool isOffset16;
+
+		static const uint16_t NO_ENTRY16 = 0xFFFF;
+
+		EntryPool() : dataSize(0), offsetCount(0), offsetCapacity(0), dataCapacity(0),
+			isSparse(false), isOffset16(false) {  }
+
+		// 稠密编码时 entry id 的范围
+		uint32_t getEntryCount() const;
+
+		// 新增的简单 entry: ResTable_entry + Res_value
+		struct NewEntry {
+			uint16_t flags;
+			uint32_t idxResKeyName;
+			uint8_t dataType;
+			uint32_t idxValue;
+		};
+
         uint32_t addNewEntry(uint16_t flags, uint32_t idxResKeyName, uint8_t dataType, uint32_t idValue);
+        // 一批 entry 只扩容一次, 返回增加的字节数
+        uint32_t addNewEntries(const std::vector<NewEntry>& newEntries);
+        void reserve(uint32_t newOffsetCount, uint32_t newDataSize);
 	};
 
 	struct ResStringPool {
@@ -32,9 +66,47 @@ public:
 		std::shared_ptr<byte> pStrings;
         std::shared_ptr<byte> pStyles;
 
-        uint32_t addNewString(std::string& newStr);
-        uint32_t addNewString_old(std::string& newStr);
+        // 字符串内容(不含长度前缀和结束符)的原始编码字节
+        const byte* getRawString(uint32_t index, uint32_t& rawSize) const;
+
+        // 解码成 utf8 后的字符串, 第一次访问时解码并缓存.
+        // 返回的引用在字符串池被修改之前一直有效.
+        const std::string& getString(uint32_t index);
+
+        // 追加到字符串池末尾, 新字符串的 index 依次是原来的 stringCount, stringCount+1, ...
+        // 返回字符串池 chunk 增加的字节数
+        uint32_t addNewString(const std::string& newStr);
+        uint32_t addNewStrings(const std::vector<std::string>& newStrs);
+        // 只保留 keep 为 true 的字符串和保留下来的 style 里 span 的名字, 按原来的顺序重新编号.
+        // remap 返回每个旧 index 的新 index, 删掉的是 -1. 返回字符串池 chunk 减少的字节数
+        uint32_t removeStrings(std::vector<bool> keep, std::vector<uint32_t>& remap);
         uint32_t getStrIdx(const std::string& destStr);
+
+        // getStrIdx 用的开放寻址哈希表, 按原始编码字节做哈希, 第一次查询时才建立.
+        // 槽里存的是 index+1, 0 表示空槽.
+        std::vector<uint32_t> strIdxTable;
+        uint32_t strIdxCount;
+
+        // getString 的缓存, 大小为 0 表示还没分配
+        std::vector<std::string> decodedStrings;
+        std::vector<bool> decodedFlags;
+
+        // addNewStrings 用的可增长缓冲区, 容量为 0 表示还指向解析出来的原始数据.
+        // stringsUsed 是字符串数组里实际用到的字节数, 不含末尾的对齐填充
+        uint32_t stringsUsed;
+        uint32_t stringsCapacity;
+        uint32_t offsetsCapacity;
+
+        // chunk 在源文件里的位置. 没改过(isDirty 为 false)的字符串池保存时直接从源文件拷贝
+        uint32_t chunkOffset;
+        bool isDirty;
+
+        ResStringPool() : strIdxCount(0), stringsUsed(0), stringsCapacity(0), offsetsCapacity(0),
+            chunkOffset(0), isDirty(false) {  }
+
+        uint32_t getStringsSize() const;
+        void buildStrIdxTable();
+        void insertStrIdx(uint32_t index);
 	};
 	typedef std::shared_ptr<ResStringPool> ResStringPoolPtr;
 
@@ -45,39 +117,145 @@ public:
 		std::vector<Res_value*> values;
 		std::vector<std::vector<ResTable_map*> > maps;
 
+		// 第一遍解析只记录 chunk 在文件里的位置和 header,
+		// entryPool/entries/values 在第一次 load() 的时候才解析
+		ResourcesFilePtr pSource;
+		uint32_t chunkOffset;
+		bool isLoaded;
+		// entry 表改过, 保存时要重新编码
+		bool isDirty;
+
+		ResTableType() : chunkOffset(0), isLoaded(false), isDirty(false) {  }
+
+		void load();
+
+        // 新 entry 依次追加在最后; 数据区扩容后 entries/values 会重新指向新的地址
         uint32_t addNewEntry(uint16_t flags, uint32_t idResKeyName, uint8_t dataType, uint32_t idValue);
+        uint32_t addNewEntries(const std::vector<EntryPool::NewEntry>& newEntries);
+
+        // 稀疏编码或者 16 位 offset 的 entry 表换成 32 位的稠密 offset 数组, 返回 chunk 增加的字节数
+        uint32_t makeDense();
+
+        // 数据区还指向解析出来的原始数据(mmap 时是只读的)的话拷贝一份, entries/values 跟着换过去.
+        // 之后可以直接修改 entry 的内容
+        void makeWritable();
 	};
 	typedef std::shared_ptr<ResTableType> ResTableTypePtr;
 
     struct ResTableTypeUnknown {
         std::shared_ptr<byte> pChunkAllData;
+        // pChunkAllData 换过, 保存时不能从源文件拷贝
+        bool isDirty;
+
+        ResTableTypeUnknown() : isDirty(false) {  }
     };
     typedef std::shared_ptr<ResTableTypeUnknown> ResTableTypeUnknownPtr;
 
+	// 第一遍扫描得到的 chunk 目录, 按文件中的顺序排列
+	struct ChunkInfo {
+		uint16_t type;
+		uint32_t offset;
+		uint32_t size;
+		ResTableTypePtr pResTableType;
+		ResTableTypeUnknownPtr pResTableUnknown;
+	};
+
 	struct PackageResource {
 		ResTable_package header;
+		// package chunk 在文件里的位置
+		uint32_t chunkOffset;
 		ResStringPoolPtr pTypes;
 		ResStringPoolPtr pKeys;
 		std::map<int, std::vector<ResTableTypePtr> > resTablePtrs;
         std::vector<ResTableTypeUnknownPtr> vecResTableUnknownPtrs;
+		std::vector<ChunkInfo> chunks;
+		// header 里除了 size 以外的字段改过, 或者删过 chunk. 自己和所有 chunk 都没改过的 package 保存时整个拷贝
+		bool isDirty;
+
+		PackageResource() : chunkOffset(0), isDirty(false) {  }
 	};
 	typedef std::shared_ptr<PackageResource> PackageResourcePtr;
 
+	// 一个 type 下所有 entry 的稠密索引, 按 entry id 直接取.
+	// configBits 每个 entry 占 configWords 个 uint64_t, 第 n 位表示第 n 个 config 里有这个 entry.
+	// 除了 keyEntries 都是普通数组, 可以原样存进 .rpidx 再读回来, 不需要 load() 任何 config
+	struct TypeIndex {
+		static const uint16_t NO_CONFIG = 0xFFFF;
+
+		const std::vector<ResTableTypePtr>* pResTableTypes;
+		bool isBuilt;
+		uint32_t entryCount;
+		uint32_t configWords;
+		// 第一个有这个 entry 的 config 下标, 没有时是 NO_CONFIG
+		std::vector<uint16_t> firstConfigs;
+		std::vector<uint32_t> keyIndices;
+		std::vector<uint64_t> configBits;
+		// key 字符串 index -> entry id, getIdForName 用. .rpidx 里按 key 排好序存成 (key, entry id) 数组
+		std::unordered_map<uint32_t, uint32_t> keyEntries;
+
+		TypeIndex() : pResTableTypes(nullptr), isBuilt(false), entryCount(0), configWords(0) {  }
+
+		bool hasConfig(uint32_t entryId, uint32_t configIdx) const {
+			return entryId < entryCount
+				&& (configBits[entryId * configWords + configIdx / 64] >> (configIdx % 64)) & 1;
+		}
+	};
+
+	// 按 type id 下标存放, 没有的 type 对应的 pResTableTypes 为 nullptr
+	struct PackageIndex {
+		PackageResourcePtr pPackage;
+		std::vector<TypeIndex> types;
+	};
+
 public:
-	ResourcesParser(const std::string& filePath);
+	// indexPath 不为空时先尝试用这个 .rpidx 恢复, 不存在或者过期了就照常解析
+	ResourcesParser(
+			const std::string& filePath,
+			ResourcesFile::LoadMode mode = ResourcesFile::LOAD_STREAM,
+			const std::string& indexPath = "");
+
+	bool isRestoredFromIndex() const {
+		return mIndexFile != nullptr;
+	}
+
+	// 默认打开, 关掉后解析时不再输出字符串池等调试信息
+	static void setDebugLog(bool enable);
 
-	static std::string getStringFromResStringPool(ResStringPoolPtr pPool, uint32_t index);
+	static const std::string& getStringFromResStringPool(ResStringPoolPtr pPool, uint32_t index);
 
 	static bool isTableMapForAttrDesc(const ResTable_ref& ref);
 
 	const std::map<std::string, PackageResourcePtr>& getResourceForPackageName() const {
 		return mResourceForPackageName;
 	}
-	std::string getStringFromGlobalStringPool(uint32_t index) const;
+	const std::string& getStringFromGlobalStringPool(uint32_t index) const;
 
 	PackageResourcePtr getPackageResouceForId(uint32_t id) const;
 
-	std::vector<ResTableTypePtr> getResTableTypesForId(uint32_t id);
+	// 返回这个 id 所在 type 的所有 config, 并且都已经 load()
+	const std::vector<ResTableTypePtr>& getResTableTypesForId(uint32_t id);
+
+	// 这个 id 所在 type 的索引, 第一次访问时才 load() 并建立; id 不存在时返回 nullptr
+	const TypeIndex* getTypeIndexForId(uint32_t id) const;
+
+	// 所有 config 里第一个不为空的 entry
+	const ResTable_entry* getFirstEntryForId(uint32_t id) const;
+
+	// 由名字查 id, packageName 为空时取第一个 package. 找不到返回 0
+	uint32_t getIdForName(
+			const std::string& packageName,
+			const std::string& type,
+			const std::string& name) const;
+
+	// 修改了 id 所在 type 的 entry 之后调用, 下次访问时重新建立索引
+	void invalidateTypeIndex(uint32_t id);
+
+	// 第二遍: 用 jobCount 个线程把所有 ResTableType 都解析出来, jobCount <= 0 时取 CPU 核数
+	void loadAllResTableTypes(int jobCount);
+
+	// 把所有 type chunk, id 索引, 字符串缓存和字符串哈希表都提前建好.
+	// 之后的查询都只读, 可以在多个线程里同时进行(ResourcesResolver 有自己的缓存, 每个线程各用一个)
+	void prepareForSharedReads(int jobCount);
 
 	std::string getNameForId(uint32_t id) const;
 
@@ -92,15 +270,75 @@ public:
     // return -1 means failed. others means success.
     uint32_t addResKeyStr(std::string pkgName, std::string resType, std::string resKeyStr);
 
-    bool saveToFile(const std::string& destFName);
+    // saveToFile 的选项
+    enum SaveFlags {
+        // type chunk 的稀疏编码(FLAG_SPARSE)比稠密的小时用稀疏编码. Android 8.0 以下读不了稀疏编码
+        SAVE_SPARSE = 0x01,
+        // 同一个 type chunk 里字节完全相同的 entry(ResTable_entry 连同值)只写一份, 多个 offset 指向它.
+        // key 也要相同, 只对 key 被合并过(比如混淆之后)的表有用, aapt 生成的表省不下任何字节
+        SAVE_DEDUP = 0x02,
+        // 没有用稀疏编码, 并且所有 offset 都放得下时用 16 位的 offset 数组(FLAG_OFFSET16).
+        // Android 14 以下读不了. 原来就是 16 位的 type chunk 不加这个选项也保持不变
+        SAVE_OFFSET16 = 0x04
+    };
+
+    // 先用 planSave 算好每个 chunk 在文件里的位置: 没改过的 chunk 从源文件直接拷贝, 改过的重新编码.
+    // jobCount 为 1 时连续的要编码的 chunk 编码进一块缓冲区一次写; 否则 jobCount 个线程各自拷贝/编码 chunk
+    // 并 pwrite 到对应位置, jobCount <= 0 时取 CPU 核数. sync 为 true 时写完 fsync.
+    // destFName 就是源文件的话先写到临时文件再 rename. flags 是 SaveFlags 的组合
+    bool saveToFile(const std::string& destFName, bool sync = false, int jobCount = 1, uint32_t flags = 0);
+
+    // 全部重新编码时写出来的文件大小
+    uint32_t getSaveSize(uint32_t flags = 0);
 
-    void writeStringPool(FILE* pFile, ResStringPool* pStringPool);
+    // 全部重新编码写到 pDest(至少 getSaveSize() 字节), 返回写入的字节数.
+    // 各 chunk 按原来在文件里的顺序排列, header 里的 size 按实际写入的大小填写
+    uint32_t writeTo(byte* pDest, uint32_t flags = 0);
 
-    void writePackageResource(FILE* pFile, PackageResource* pPkgRes);
+    static uint32_t getStringPoolSaveSize(const ResStringPool* pStringPool);
 
-    void writeResTableType(FILE* pFile, ResTableType* pResTable);
+    static uint32_t getPackageSaveSize(PackageResource* pPkgRes, uint32_t flags);
 
-    void writeResTableUnknown(FILE* pFile, ResTableTypeUnknown* pResTableUnknown);
+    static uint32_t getResTableTypeSaveSize(ResTableType* pResTable, uint32_t flags);
+
+    static uint32_t writeStringPool(byte* pDest, const ResStringPool* pStringPool);
+
+    static uint32_t writePackageResource(byte* pDest, PackageResource* pPkgRes, uint32_t flags);
+
+    static uint32_t writeResTableType(byte* pDest, ResTableType* pResTable, uint32_t flags);
+
+    static uint32_t writeResTableUnknown(byte* pDest, const ResTableTypeUnknown* pResTableUnknown);
+
+    // saveToFile 里的一个写入任务: 从源文件拷贝的一段(相邻的没改过的 chunk 合在一起),
+    // 或者要重新编码的一个字符串池/type chunk/其他 chunk/文件和 package 的 header
+    struct SaveChunk {
+        uint32_t offset;
+        uint32_t size;
+        // 在源文件里的位置, -1 表示要重新编码
+        int64_t sourceOffset;
+        const byte* pHeader;
+        ResStringPool* pStringPool;
+        ResTableType* pResTableType;
+        ResTableTypeUnknown* pResTableUnknown;
+    };
+
+    // 排好所有写入任务, 返回文件大小. 文件和 package 的 header 拷贝到 fileHeader/packageHeaders 里填好最终大小.
+    // pDedupSaved 不为空时返回 SAVE_DEDUP 省掉的 entry 数据字节数
+    uint32_t planSave(
+            std::vector<SaveChunk>& chunks,
+            ResTable_header& fileHeader,
+            std::vector<ResTable_package>& packageHeaders,
+            uint32_t flags,
+            uint32_t* pDedupSaved = nullptr);
+
+    // 没改过并且按 flags 也不需要换编码的 chunk 才能直接从源文件拷贝
+    bool canCopyResTableType(const ResTableType* pResTable, uint32_t flags) const;
+
+    bool canCopyPackage(const PackageResource* pPkgRes, uint32_t flags) const;
+
+    bool writeSaveChunks(int fd, const std::vector<SaveChunk>& chunks, int jobCount, uint32_t flags) const;
+
+    static uint32_t writeSaveChunk(byte* pDest, const SaveChunk& chunk, uint32_t flags);
 
 
 
@@ -111,22 +349,34 @@ public:
 	std::map<std::string, PackageResourcePtr> mResourceForPackageName;
 	std::map<uint32_t, PackageResourcePtr> mResourceForId;
 	std::vector<ResTable_package> mPackageTables;
+	ResourcesFilePtr mFile;
+	// 从 .rpidx 恢复时用来按需读取 type 索引, 修改过 parser 之后就不再使用
+	std::shared_ptr<ResourcesIndex> mIndexFile;
+	// 按 package id 下标存放
+	mutable std::vector<PackageIndex> mIdIndex;
+
+	void buildIdIndex();
 
-	ResStringPoolPtr parserResStringPool(std::ifstream& resources);
+	ResStringPoolPtr parserResStringPool(ResourcesStream& resources);
 
-	PackageResourcePtr parserPackageResource(std::ifstream& resources);
+	PackageResourcePtr parserPackageResource(ResourcesStream& resources);
 
-	EntryPool parserEntryPool(
-			std::ifstream& resources,
+	// typeFlags 是 ResTable_type 的 flags. FLAG_SPARSE 时 entryCount 是 ResTable_sparseTypeEntry 的个数
+	static EntryPool parserEntryPool(
+			ResourcesStream& resources,
 			uint32_t entryCount,
 			uint32_t dataStart,
-			uint32_t dataSize);
+			uint32_t dataSize,
+			uint8_t typeFlags);
+
+	static ResTable_entry* getEntryFromEntryPool(const EntryPool& pool, uint32_t index);
 
-	ResTable_entry* getEntryFromEntryPool(EntryPool pool, uint32_t index);
+	static Res_value* getValueFromEntry(const ResTable_entry* pEntry);
 
-	Res_value* getValueFromEntry(const ResTable_entry* pEntry);
+	static ResTable_map* getMapsFromEntry(const ResTable_entry* pEntry);
 
-	ResTable_map* getMapsFromEntry(const ResTable_entry* pEntry);
+	// entry 连同它的值(或者所有 ResTable_map)一共占的字节数
+	static uint32_t getEntrySize(const ResTable_entry* pEntry);
 };
 void printHex(unsigned char* pBuf, unsigned int uLenBuf);
 #endif  /*RESOURCES_PARSER_H*/
@@ -1,6 +1,8 @@
 #include "ResourcesParserInterpreter.h"
 #include <iostream>
 #include <sstream>
+#include <iomanip>
+#include <algorithm>
 
 #define ID(x) (x + 1)
 #define MAKE_RESOURCE_ID(PACKAGE,TYPE,INDEX) ((PACKAGE<<24) | (TYPE<<16) | INDEX)
@@ -24,10 +26,10 @@ const string ResourcesParserInterpreter::INTEGER_TYPE = "integer";
 
 void ResourcesParserInterpreter::parserResource(const string& type) {
 	for(auto it : mParser->getResourceForPackageName()) {
-		cout<<it.first<<endl;
+		mOut<<it.first<<endl;
 		ResourcesParser::ResStringPoolPtr types = it.second->pTypes;
 		for(uint32_t i = 0 ; i < types->header.stringCount ; i++) {
-			string resType = ResourcesParser::getStringFromResStringPool(types, i);
+			const string& resType = ResourcesParser::getStringFromResStringPool(types, i);
 			if(type==ALL_TYPE || type == resType){
 				parserResource(it.second, ID(i), resType, "\t");
 			}
@@ -40,8 +42,14 @@ void ResourcesParserInterpreter::parserResource(
 		uint32_t typeId,
 		const string& type,
 		const string& tab) {
-	for(ResourcesParser::ResTableTypePtr pResTableType : packageRes->resTablePtrs[typeId]) {
+	// 用 find, 不能给没有 chunk 的 type 插入空的 vector, serve 时多个线程在同时读
+	auto it = packageRes->resTablePtrs.find(typeId);
+	if(it == packageRes->resTablePtrs.end()) {
+		return;
+	}
+	for(ResourcesParser::ResTableTypePtr pResTableType : it->second) {
 		bool showConfigDirectory = true;
+		pResTableType->load();
 
 		for(int i = 0 ; i < pResTableType->entries.size() ; i++) {
 			if(pResTableType->entries[i] == nullptr){
@@ -49,7 +57,7 @@ void ResourcesParserInterpreter::parserResource(
 			}
 			if(showConfigDirectory) {
 				string config = getConfigDirectory(pResTableType->header.config, type);
-				cout<<endl<<tab<<config<<endl;
+				mOut<<endl<<tab<<config<<endl;
 				showConfigDirectory = false;
 			}
 			auto pEntry = pResTableType->entries[i];
@@ -60,7 +68,8 @@ void ResourcesParserInterpreter::parserResource(
 					pEntry,
 					pResTableType->values[i],
 					type,
-					tab + "\t");
+					tab + "\t",
+					mOut);
 		}
 	}
 }
@@ -71,14 +80,15 @@ void ResourcesParserInterpreter::parserEntry(
 		ResTable_entry* pEntry,
 		Res_value* pValue,
 		const string& type,
-		const string& tab) {
-	string key = ResourcesParser::getStringFromResStringPool(pKeys, pEntry->key.index);
+		const string& tab,
+		ostream& out) {
+	const string& key = ResourcesParser::getStringFromResStringPool(pKeys, pEntry->key.index);
 	if(pEntry->flags & ResTable_entry::FLAG_COMPLEX) {
-		cout <<tab<<key<<endl;
+		out <<tab<<key<<endl;
 		ResTable_map_entry* pMapEntry = (ResTable_map_entry*)pEntry;
 		ResTable_map* pMap = (ResTable_map*)pValue;
 		if(pMapEntry->parent.ident!= 0) {
-			cout <<tab+"\t" <<"parent: " <<mParser->getNameForId(pMapEntry->parent.ident) <<endl;
+			out <<tab+"\t" <<"parent: " <<mParser->getNameForId(pMapEntry->parent.ident) <<endl;
 		}
 
 		for(int i = 0 ; i < pMapEntry->count ; i++) {
@@ -87,13 +97,13 @@ void ResourcesParserInterpreter::parserEntry(
 			uint32_t ident = (pMap+i)->name.ident;
 
 			if(!ResourcesParser::isTableMapForAttrDesc((pMap+i)->name)){
-				cout
+				out
 					<<tab+"\t\t" <<name
 					<<"(" <<*dec <<ident <<" or 0x" <<hex <<ident <<") = "
 					<<mParser->stringOfValue(&(pMap+i)->value)
 					<<endl;
 			} else {
-				cout <<tab+"\t" <<name
+				out <<tab+"\t" <<name
 					<<"(" <<*dec <<ident <<" or 0x" <<hex <<ident <<") "
 					<<mParser->getValueTypeForResTableMap((pMap+i)->value)
 					<<endl;
@@ -101,38 +111,161 @@ void ResourcesParserInterpreter::parserEntry(
 		}
 	}else{
 		if(ID_TYPE == type) {
-			cout <<tab+"\t" <<key <<" (" <<*dec <<resId <<" or 0x" <<hex <<resId <<")"<<endl;
+			out <<tab+"\t" <<key <<" (" <<*dec <<resId <<" or 0x" <<hex <<resId <<")"<<endl;
 		} else {
 			string value = mParser->stringOfValue(pValue);
-			cout <<tab+"\t" <<key <<" (" <<*dec <<resId <<" or 0x" <<hex <<resId <<")"
+			out <<tab+"\t" <<key <<" (" <<*dec <<resId <<" or 0x" <<hex <<resId <<")"
 				<<" = " <<value <<endl;
 		}
 	}
 }
 
-void ResourcesParserInterpreter::parserId(const string& id) {
-	uint32_t uid;
+uint32_t ResourcesParserInterpreter::parseId(const string& id) {
+	uint32_t uid = 0;
 	if(0 == strncmp(id.c_str(), "0x", 2)) {
 		istringstream(id)>>hex>>uid;
 	} else {
 		istringstream(id)>>uid;
 	}
-	vector<ResourcesParser::ResTableTypePtr> resTableTypePtrs = mParser->getResTableTypesForId(uid);
-	if(resTableTypePtrs.empty()) {
-		cout <<"can't find resource for " <<id <<endl;
+	return uid;
+}
+
+void ResourcesParserInterpreter::parserId(const string& id) {
+	parserId(parseId(id), id, mOut);
+}
+
+void ResourcesParserInterpreter::parserId(uint32_t uid, const string& id, ostream& out) {
+	const ResourcesParser::TypeIndex* pIndex = mParser->getTypeIndexForId(uid);
+	if(pIndex == nullptr || mParser->getFirstEntryForId(uid) == nullptr) {
+		out <<"can't find resource for " <<id <<endl;
 	} else {
 		ResourcesParser::PackageResourcePtr pPackage = mParser->getPackageResouceForId(uid);
 		uint32_t typeId = TYPE_ID(uid);
 		uint32_t entryId = ENTRY_ID(uid);
-		string type = ResourcesParser::getStringFromResStringPool(pPackage->pTypes, typeId-1);
-		for(ResourcesParser::ResTableTypePtr pResTableType : resTableTypePtrs) {
-			ResTable_entry* pEntry = pResTableType->entries[entryId];
-			Res_value* pValue = pResTableType->values[entryId];
-			if(nullptr != pEntry) {
-				cout <<getConfigDirectory(pResTableType->header.config, type) << " : ";
-				parserEntry(uid, pPackage->pKeys, pEntry, pValue, type, "");
-				cout <<endl;
+		const string& type = ResourcesParser::getStringFromResStringPool(pPackage->pTypes, typeId-1);
+		const vector<ResourcesParser::ResTableTypePtr>& resTableTypePtrs = *pIndex->pResTableTypes;
+		for(uint32_t config = 0 ; config < resTableTypePtrs.size() ; config++) {
+			if(!pIndex->hasConfig(entryId, config)) {
+				continue;
 			}
+			ResourcesParser::ResTableTypePtr pResTableType = resTableTypePtrs[config];
+			pResTableType->load();
+			out <<getConfigDirectory(pResTableType->header.config, type) << " : ";
+			parserEntry(uid, pPackage->pKeys, pResTableType->entries[entryId], pResTableType->values[entryId], type, "", out);
+			out <<endl;
+		}
+	}
+}
+
+void ResourcesParserInterpreter::parserIds(istream& in) {
+	vector<string> ids;
+	vector<uint32_t> uids;
+	string id;
+	while(in >> id) {
+		ids.push_back(id);
+		uids.push_back(parseId(id));
+	}
+
+	// 按 id 排序后同一个 type 的查询挨在一起, entry 也是按内存顺序访问的,
+	// 每个 type 只在第一次查询时解析一次
+	vector<uint32_t> order(ids.size());
+	for(uint32_t i = 0 ; i < order.size() ; i++) {
+		order[i] = i;
+	}
+	stable_sort(order.begin(), order.end(), [&uids](uint32_t a, uint32_t b) {
+		return uids[a] < uids[b];
+	});
+
+	vector<string> results(ids.size());
+	for(uint32_t i : order) {
+		ostringstream out;
+		parserId(uids[i], ids[i], out);
+		results[i] = out.str();
+	}
+
+	// 按输入顺序输出, 格式和逐个 -i 查询一样
+	for(const string& result : results) {
+		mOut <<result;
+	}
+	mOut.flush();
+}
+
+void ResourcesParserInterpreter::parserId(const string& id, const string& config) {
+	ResTable_config target;
+	if(!target.fromString(config)) {
+		mOut <<"unknown config " <<config <<endl;
+		return;
+	}
+	uint32_t uid = parseId(id);
+	ResourcesParser::ResTableTypePtr pResTableType = mResolver.resolve(uid, target);
+	if(pResTableType == nullptr) {
+		mOut <<"can't find resource for " <<id <<" in config " <<config <<endl;
+		return;
+	}
+	ResourcesParser::PackageResourcePtr pPackage = mParser->getPackageResouceForId(uid);
+	const string& type = ResourcesParser::getStringFromResStringPool(pPackage->pTypes, TYPE_ID(uid)-1);
+	uint32_t entryId = ENTRY_ID(uid);
+	mOut <<getConfigDirectory(pResTableType->header.config, type) << " : ";
+	parserEntry(uid, pPackage->pKeys, pResTableType->entries[entryId], pResTableType->values[entryId], type, "", mOut);
+
+	// 引用的话再输出引用链最终的值
+	const Res_value* pValue = pResTableType->values[entryId];
+	if(!(pResTableType->entries[entryId]->flags & ResTable_entry::FLAG_COMPLEX)
+			&& pValue->dataType == Res_value::TYPE_REFERENCE) {
+		Res_value resolved;
+		bool isResolved = mResolver.resolveValue(*pValue, target, resolved);
+		mOut <<"\t-> " <<mParser->stringOfValue(&resolved) <<(isResolved ? "" : " (unresolved)") <<endl;
+	}
+	mOut <<endl;
+}
+
+void ResourcesParserInterpreter::parserStyle(const string& id, const string& config) {
+	ResTable_config target;
+	if(!target.fromString(config)) {
+		mOut <<"unknown config " <<config <<endl;
+		return;
+	}
+	uint32_t uid = parseId(id);
+	ResourcesResolver::BagPtr pBag = mResolver.resolveBag(uid, target);
+	if(pBag == nullptr) {
+		mOut <<"can't resolve style for " <<id <<endl;
+		return;
+	}
+	mOut <<mParser->getNameForId(uid) <<" (" <<dec <<uid <<" or 0x" <<hex <<uid <<")" <<endl;
+	for(const ResourcesResolver::BagEntry& bagEntry : *pBag) {
+		ResTable_ref ref = { bagEntry.attr };
+		string name = mParser->getNameForResTableMap(ref);
+		if(!ResourcesParser::isTableMapForAttrDesc(ref)) {
+			mOut <<"\t" <<name
+				<<"(" <<dec <<bagEntry.attr <<" or 0x" <<hex <<bagEntry.attr <<") = "
+				<<mParser->stringOfValue(&bagEntry.value)
+				<<endl;
+		} else {
+			mOut <<"\t" <<name
+				<<"(" <<dec <<bagEntry.attr <<" or 0x" <<hex <<bagEntry.attr <<") "
+				<<mParser->getValueTypeForResTableMap(bagEntry.value)
+				<<endl;
 		}
 	}
+	mOut <<dec;
+}
+
+void ResourcesParserInterpreter::parserName(const string& name) {
+	string package;
+	string typeAndKey = name[0] == '@' ? name.substr(1) : name;
+	size_t colon = typeAndKey.find(':');
+	if(colon != string::npos) {
+		package = typeAndKey.substr(0, colon);
+		typeAndKey = typeAndKey.substr(colon + 1);
+	}
+	size_t slash = typeAndKey.find('/');
+	uint32_t uid = 0;
+	if(slash != string::npos) {
+		uid = mParser->getIdForName(package, typeAndKey.substr(0, slash), typeAndKey.substr(slash + 1));
+	}
+	if(uid == 0) {
+		mOut <<"can't find resource for " <<name <<endl;
+		return;
+	}
+	mOut <<name <<" (" <<dec <<uid <<" or 0x" <<hex <<setw(8) <<setfill('0') <<uid <<")" <<dec <<endl;
 }
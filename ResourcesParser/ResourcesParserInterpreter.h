@@ -3,8 +3,10 @@
 
 #include "ResourceTypes.h"
 #include "ResourcesParser.h"
+#include "ResourcesResolver.h"
 
 #include <string>
+#include <iostream>
 
 class ResourcesParserInterpreter {
 public:
@@ -23,7 +25,9 @@ public:
 	static const std::string ID_TYPE;
 	static const std::string INTEGER_TYPE;
 
-	ResourcesParserInterpreter(ResourcesParser* parser) : mParser(parser) {  }
+	// 所有结果都输出到 out
+	ResourcesParserInterpreter(ResourcesParser* parser, std::ostream& out = std::cout)
+		: mParser(parser), mResolver(parser), mOut(out) {  }
 
 	static std::string getConfigDirectory(const ResTable_config& config, const std::string& type) {
 		std::string str = config.toString();
@@ -34,8 +38,24 @@ public:
 
 	void parserId(const std::string& id);
 
+	// 从 in 里读入一批 id(空白分隔), 解析一次回答所有查询, 按输入顺序输出
+	void parserIds(std::istream& in);
+
+	// 只输出 config(限定符字符串, 如 en-rUS-xhdpi-v28)下实际生效的那个值
+	void parserId(const std::string& id, const std::string& config);
+
+	// 输出 style 合并了所有 parent 之后的属性, config 为空时用默认配置
+	void parserStyle(const std::string& id, const std::string& config);
+
+	// [package:]type/name, 输出对应的 id
+	void parserName(const std::string& name);
+
 private:
 	ResourcesParser* mParser;
+	ResourcesResolver mResolver;
+	std::ostream& mOut;
+
+	static uint32_t parseId(const std::string& id);
 
 	void parserEntry(
 		uint32_t resId,
@@ -43,7 +63,10 @@ private:
 		ResTable_entry* pEntry,
 		Res_value* pValue,
 		const std::string& type,
-		const std::string& tab);
+		const std::string& tab,
+		std::ostream& out);
+
+	void parserId(uint32_t uid, const std::string& id, std::ostream& out);
 
 	void parserResource(
 		ResourcesParser::PackageResourcePtr packageRes,
@@ -0,0 +1,217 @@
+#include "ResourcesResolver.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+uint32_t ResourcesResolver::getConfigId(const ResTable_config& config) {
+	string key((const char*)&config, sizeof(ResTable_config));
+	auto it = mConfigIds.find(key);
+	if(it != mConfigIds.end()) {
+		return it->second;
+	}
+	uint32_t configId = mConfigIds.size();
+	mConfigIds[key] = configId;
+	return configId;
+}
+
+const vector<uint16_t>* ResourcesResolver::resolveType(uint32_t id, const ResTable_config& config) {
+	const uint32_t typeKey = id >> 16;
+	const uint64_t key = ((uint64_t)getConfigId(config) << 16) | typeKey;
+	auto resolved = mResolved.find(key);
+	if(resolved != mResolved.end()) {
+		return &resolved->second;
+	}
+
+	const ResourcesParser::TypeIndex* pIndex = mParser->getTypeIndexForId(id);
+	if(pIndex == nullptr) {
+		return nullptr;
+	}
+
+	auto candidatesIt = mCandidates.find(typeKey);
+	if(candidatesIt == mCandidates.end()) {
+		vector<ResTable_config> candidates;
+		for(ResourcesParser::ResTableTypePtr pResTableType : *pIndex->pResTableTypes) {
+			candidates.push_back(pResTableType->header.config);
+		}
+		candidatesIt = mCandidates.insert(make_pair(typeKey, candidates)).first;
+	}
+	const vector<ResTable_config>& candidates = candidatesIt->second;
+
+	// 先把不匹配的 config 排除掉, 每个 entry 只在剩下的里面比较
+	vector<uint32_t> matched;
+	for(uint32_t i = 0 ; i < candidates.size() ; i++) {
+		if(candidates[i].match(config)) {
+			matched.push_back(i);
+		}
+	}
+
+	vector<uint16_t>& result = mResolved[key];
+	result.assign(pIndex->entryCount, 0);
+	for(uint32_t entryId = 0 ; entryId < pIndex->entryCount ; entryId++) {
+		int best = -1;
+		for(uint32_t i : matched) {
+			if(!pIndex->hasConfig(entryId, i)) {
+				continue;
+			}
+			if(best < 0 || candidates[i].isBetterThan(candidates[best], config)) {
+				best = i;
+			}
+		}
+		result[entryId] = best + 1;
+	}
+	return &result;
+}
+
+ResourcesParser::ResTableTypePtr ResourcesResolver::resolve(uint32_t id, const ResTable_config& config) {
+	const vector<uint16_t>* pResolved = resolveType(id, config);
+	if(pResolved == nullptr || ENTRY_ID(id) >= pResolved->size() || (*pResolved)[ENTRY_ID(id)] == 0) {
+		return nullptr;
+	}
+	ResourcesParser::ResTableTypePtr pResTableType =
+		(*mParser->getTypeIndexForId(id)->pResTableTypes)[(*pResolved)[ENTRY_ID(id)] - 1];
+	pResTableType->load();
+	return pResTableType;
+}
+
+ResourcesResolver::BagPtr ResourcesResolver::resolveBag(uint32_t id, const ResTable_config& config) {
+	const uint64_t key = ((uint64_t)getConfigId(config) << 32) | id;
+	auto cached = mBags.find(key);
+	if(cached != mBags.end()) {
+		return cached->second;
+	}
+	if(mResolvingBags.count(key) > 0) {
+		cout <<"[resolveBag] parent cycle at 0x" <<hex <<id <<dec <<endl;
+		return nullptr;
+	}
+
+	ResourcesParser::ResTableTypePtr pResTableType = resolve(id, config);
+	if(pResTableType == nullptr) {
+		return nullptr;
+	}
+	const ResTable_entry* pEntry = pResTableType->entries[ENTRY_ID(id)];
+	if(!(pEntry->flags & ResTable_entry::FLAG_COMPLEX)) {
+		return nullptr;
+	}
+	const ResTable_map_entry* pMapEntry = (const ResTable_map_entry*)pEntry;
+	const ResTable_map* pMap = ResourcesParser::getMapsFromEntry(pEntry);
+
+	BagPtr pParent;
+	const uint32_t parentId = pMapEntry->parent.ident;
+	if(parentId != 0 && mParser->getPackageResouceForId(parentId) != nullptr) {
+		mResolvingBags.insert(key);
+		pParent = resolveBag(parentId, config);
+		mResolvingBags.erase(key);
+		if(pParent == nullptr) {
+			// 环上的每个 style 都算失败
+			mBags[key] = nullptr;
+			return nullptr;
+		}
+	}
+
+	// 自己的部分按 attr 排序, 同一个 attr 出现多次时后面的生效
+	Bag own;
+	own.reserve(pMapEntry->count);
+	for(uint32_t i = 0 ; i < pMapEntry->count ; i++) {
+		BagEntry bagEntry = { (pMap+i)->name.ident, (pMap+i)->value };
+		own.push_back(bagEntry);
+	}
+	stable_sort(own.begin(), own.end(), [](const BagEntry& a, const BagEntry& b) {
+		return a.attr < b.attr;
+	});
+
+	shared_ptr<Bag> pBag = make_shared<Bag>();
+	const Bag empty;
+	const Bag& parent = pParent != nullptr ? *pParent : empty;
+	pBag->reserve(parent.size() + own.size());
+	size_t p = 0;
+	for(size_t o = 0 ; o < own.size() ; o++) {
+		if(o + 1 < own.size() && own[o + 1].attr == own[o].attr) {
+			continue;
+		}
+		for(; p < parent.size() && parent[p].attr < own[o].attr ; p++) {
+			pBag->push_back(parent[p]);
+		}
+		if(p < parent.size() && parent[p].attr == own[o].attr) {
+			p++;
+		}
+		pBag->push_back(own[o]);
+	}
+	pBag->insert(pBag->end(), parent.begin() + p, parent.end());
+
+	mBags[key] = pBag;
+	return pBag;
+}
+
+bool ResourcesResolver::resolveValue(const Res_value& value, const ResTable_config& config, Res_value& outValue) {
+	outValue = value;
+	if(value.dataType != Res_value::TYPE_REFERENCE || value.data == 0) {
+		return true;
+	}
+	bool depthExceeded = false;
+	ResolvedValue resolved = resolveReference(value.data, getConfigId(config), config, 1, depthExceeded);
+	outValue = resolved.value;
+	return resolved.isResolved;
+}
+
+ResourcesResolver::ResolvedValue ResourcesResolver::resolveReference(
+		uint32_t id,
+		uint32_t configId,
+		const ResTable_config& config,
+		int depth,
+		bool& depthExceeded) {
+	const uint64_t key = ((uint64_t)configId << 32) | id;
+	auto cached = mValues.find(key);
+	if(cached != mValues.end()) {
+		return cached->second;
+	}
+
+	// 失败时的值就是这个没法继续解析的引用
+	ResolvedValue result;
+	result.isResolved = false;
+	result.value.size = sizeof(Res_value);
+	result.value.res0 = 0;
+	result.value.dataType = Res_value::TYPE_REFERENCE;
+	result.value.data = id;
+
+	if(depth > MAX_REFERENCE_DEPTH) {
+		depthExceeded = true;
+		return result;
+	}
+	if(mResolvingValues.count(key) > 0) {
+		cout <<"[resolveValue] reference cycle at 0x" <<hex <<id <<dec <<endl;
+		return result;
+	}
+
+	ResourcesParser::ResTableTypePtr pResTableType = resolve(id, config);
+	if(pResTableType != nullptr) {
+		const ResTable_entry* pEntry = pResTableType->entries[ENTRY_ID(id)];
+		const Res_value* pValue = pResTableType->values[ENTRY_ID(id)];
+		if(pEntry->flags & ResTable_entry::FLAG_COMPLEX) {
+			result.isResolved = true;
+		} else if(pValue->dataType == Res_value::TYPE_REFERENCE && pValue->data != 0) {
+			mResolvingValues.insert(key);
+			result = resolveReference(pValue->data, configId, config, depth + 1, depthExceeded);
+			mResolvingValues.erase(key);
+		} else {
+			result.isResolved = true;
+			result.value = *pValue;
+		}
+	}
+
+	if(!depthExceeded) {
+		mValues[key] = result;
+	}
+	return result;
+}
+
+void ResourcesResolver::clearCache() {
+	mValues.clear();
+	mResolvingValues.clear();
+	mBags.clear();
+	mResolvingBags.clear();
+	mConfigIds.clear();
+	mResolved.clear();
+	mCandidates.clear();
+}
@@ -0,0 +1,83 @@
+#ifndef RESOURCES_RESOLVER_H
+#define RESOURCES_RESOLVER_H
+
+#include "ResourceTypes.h"
+#include "ResourcesParser.h"
+
+#include <string>
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+
+/**
+ * 按设备配置选出每个资源实际生效的那个 config, 规则和运行时的
+ * ResTable_config::match / isBetterThan 一致.
+ *
+ * 每个 type 的候选 config 只从 ResTableType 里拷一次, 选择结果按 (config, type) 缓存,
+ * 同一个设备配置下再查同一个 type 的其他资源不需要重新比较.
+ * 不是线程安全的; 修改过 parser 之后需要 clearCache().
+ */
+class ResourcesResolver {
+public:
+	ResourcesResolver(ResourcesParser* parser) : mParser(parser) {  }
+
+	// id 在 config 下选中的 ResTableType(已经 load()), 没有匹配的返回 nullptr
+	ResourcesParser::ResTableTypePtr resolve(uint32_t id, const ResTable_config& config);
+
+	// id 所在 type 里每个 entry 选中的 config 下标 + 1, 0 表示没有匹配. type 不存在时返回 nullptr
+	const std::vector<uint16_t>* resolveType(uint32_t id, const ResTable_config& config);
+
+	// 合并了所有 parent 之后的 style/bag, 按 attr id 排序, 子 style 的值覆盖 parent 的
+	struct BagEntry {
+		uint32_t attr;
+		Res_value value;
+	};
+	typedef std::vector<BagEntry> Bag;
+	typedef std::shared_ptr<const Bag> BagPtr;
+
+	// 不是 bag, parent 链有环时返回 nullptr. 结果按 (config, id) 缓存,
+	// 共用祖先的 style 直接用缓存里祖先合并好的结果.
+	// parent 在别的 package(比如 android:)里的时候只合并能找到的部分
+	BagPtr resolveBag(uint32_t id, const ResTable_config& config);
+
+	// 沿着 TYPE_REFERENCE 找到最终的值, 结果按 (config, id) 缓存, 每个 id 在一个 config 下只解析一次.
+	// 引用的是 bag 时最终值就是这个引用本身; TYPE_ATTRIBUTE 依赖主题, 也原样返回.
+	// 引用不存在, 有环或者超过 MAX_REFERENCE_DEPTH 时返回 false, outValue 是最后一个拿到的值
+	bool resolveValue(const Res_value& value, const ResTable_config& config, Res_value& outValue);
+
+	static const int MAX_REFERENCE_DEPTH = 32;
+
+	void clearCache();
+
+private:
+	ResourcesParser* mParser;
+
+	// 配置按内容编号, 缓存的 key 是 (配置编号, package id, type id)
+	std::map<std::string, uint32_t> mConfigIds;
+	std::unordered_map<uint64_t, std::vector<uint16_t> > mResolved;
+
+	// (package id, type id) -> 这个 type 所有 config, 连续存放方便逐个比较
+	std::unordered_map<uint32_t, std::vector<ResTable_config> > mCandidates;
+
+	// (配置编号, id) -> 合并好的 bag
+	std::unordered_map<uint64_t, BagPtr> mBags;
+	// 正在合并的 bag, 用来发现 parent 链上的环
+	std::unordered_set<uint64_t> mResolvingBags;
+
+	struct ResolvedValue {
+		bool isResolved;
+		Res_value value;
+	};
+	// (配置编号, id) -> 引用链最终的值
+	std::unordered_map<uint64_t, ResolvedValue> mValues;
+	std::unordered_set<uint64_t> mResolvingValues;
+
+	// depthExceeded: 失败是不是因为深度超限, 这种结果和起点有关, 不能缓存
+	ResolvedValue resolveReference(uint32_t id, uint32_t configId, const ResTable_config& config, int depth, bool& depthExceeded);
+
+	uint32_t getConfigId(const ResTable_config& config);
+};
+
+#endif  /*RESOURCES_RESOLVER_H*/
@@ -0,0 +1,268 @@
+#include "ResourcesServer.h"
+#include "ResourcesParserInterpreter.h"
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+using namespace std;
+
+// 一行请求的最大长度, 超过了直接断开, 避免缓冲区无限增长
+static const size_t MAX_REQUEST_SIZE = 1 << 20;
+
+static bool sendAll(int fd, const string& data) {
+	size_t sent = 0;
+	while(sent < data.size()) {
+		ssize_t n = send(fd, data.data() + sent, data.size() - sent, 0);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			return false;
+		}
+		sent += n;
+	}
+	return true;
+}
+
+static bool sendOk(int fd, const string& payload) {
+	ostringstream header;
+	header <<"OK " <<payload.size() <<"\n";
+	return sendAll(fd, header.str() + payload);
+}
+
+static bool sendError(int fd, const string& reason) {
+	return sendAll(fd, "ERR " + reason + "\n");
+}
+
+ResourcesServer::ResourcesServer(const string& socketPath, const vector<string>& tablePaths, int jobCount)
+		: mSocketPath(socketPath), mJobCount(jobCount) {
+	for(const string& path : tablePaths) {
+		Table table;
+		table.path = path;
+		setFileInfo(table, {});
+		mTables.push_back(table);
+	}
+}
+
+shared_ptr<ResourcesParser> ResourcesServer::loadTable(const string& path) {
+	// 用拷贝的方式加载, mmap 的话文件被原地改写时正在查询的表也会跟着变
+	shared_ptr<ResourcesParser> pParser = make_shared<ResourcesParser>(path, ResourcesFile::LOAD_STREAM);
+	if(pParser->mGlobalStringPool == nullptr
+			|| pParser->mResourceForId.size() != pParser->mResourcesInfo.packageCount) {
+		return nullptr;
+	}
+	pParser->prepareForSharedReads(mJobCount);
+	return pParser;
+}
+
+void ResourcesServer::setFileInfo(Table& table, const struct stat& st) {
+	table.mtime = st.st_mtim;
+	table.ctime = st.st_ctim;
+	table.size = st.st_size;
+	table.inode = st.st_ino;
+}
+
+bool ResourcesServer::isSameFileInfo(const Table& a, const Table& b) {
+	return a.mtime.tv_sec == b.mtime.tv_sec
+		&& a.mtime.tv_nsec == b.mtime.tv_nsec
+		&& a.ctime.tv_sec == b.ctime.tv_sec
+		&& a.ctime.tv_nsec == b.ctime.tv_nsec
+		&& a.size == b.size
+		&& a.inode == b.inode;
+}
+
+shared_ptr<ResourcesParser> ResourcesServer::getParser(size_t index) {
+	lock_guard<mutex> lock(mMutex);
+	if(index >= mTables.size()) {
+		return nullptr;
+	}
+	return mTables[index].pParser;
+}
+
+void ResourcesServer::watchTables() {
+	while(true) {
+		this_thread::sleep_for(chrono::seconds(1));
+		for(size_t i = 0 ; i < mTables.size() ; i++) {
+			struct stat st;
+			if(stat(mTables[i].path.c_str(), &st) != 0) {
+				continue;
+			}
+			Table current;
+			setFileInfo(current, st);
+			{
+				lock_guard<mutex> lock(mMutex);
+				if(isSameFileInfo(current, mTables[i])) {
+					continue;
+				}
+			}
+
+			// 解析的时候不持有锁, 其他连接继续用旧的表. 解析失败(比如文件还没写完)下一秒再试
+			shared_ptr<ResourcesParser> pParser = loadTable(mTables[i].path);
+			if(pParser == nullptr) {
+				continue;
+			}
+			// 记下解析的那个 fd 打开时的信息, 而不是上面 stat 的: 两次之间又改过的话下一秒还会再加载
+			lock_guard<mutex> lock(mMutex);
+			setFileInfo(mTables[i], pParser->mFile->getStat());
+			mTables[i].pParser = pParser;
+			cout <<"reloaded " <<mTables[i].path <<endl;
+		}
+	}
+}
+
+void ResourcesServer::serveClient(int fd) {
+	size_t tableIndex = 0;
+	ostringstream out;
+	shared_ptr<ResourcesParser> pParser;
+	unique_ptr<ResourcesParserInterpreter> pInterpreter;
+	string pending;
+	char buf[4096];
+
+	while(true) {
+		size_t lineEnd = pending.find('\n');
+		if(lineEnd == string::npos) {
+			if(pending.size() > MAX_REQUEST_SIZE) {
+				sendError(fd, "request too long");
+				break;
+			}
+			ssize_t n = recv(fd, buf, sizeof(buf), 0);
+			if(n < 0 && errno == EINTR) {
+				continue;
+			}
+			if(n <= 0) {
+				break;
+			}
+			pending.append(buf, n);
+			continue;
+		}
+		string line = pending.substr(0, lineEnd);
+		pending.erase(0, lineEnd + 1);
+		if(!line.empty() && line[line.size() - 1] == '\r') {
+			line.erase(line.size() - 1);
+		}
+
+		istringstream request(line);
+		string command;
+		string arg;
+		string config;
+		request >>command >>arg >>config;
+		if(command.empty()) {
+			continue;
+		}
+		if(command == "quit") {
+			break;
+		}
+
+		bool sent = true;
+		if(command == "tables") {
+			ostringstream tables;
+			for(size_t i = 0 ; i < mTables.size() ; i++) {
+				tables <<i <<" " <<mTables[i].path <<"\n";
+			}
+			sent = sendOk(fd, tables.str());
+		} else if(command == "use") {
+			size_t index = strtoul(arg.c_str(), nullptr, 10);
+			if(arg.empty() || index >= mTables.size()) {
+				sent = sendError(fd, "no table " + arg);
+			} else {
+				tableIndex = index;
+				sent = sendOk(fd, "");
+			}
+		} else {
+			// 文件重新加载过的话换成新的表, 旧表在最后一个使用者放手后释放
+			shared_ptr<ResourcesParser> pCurrent = getParser(tableIndex);
+			if(pCurrent != pParser) {
+				pInterpreter.reset(new ResourcesParserInterpreter(pCurrent.get(), out));
+				pParser = pCurrent;
+			}
+			out.str("");
+			out.clear();
+			out.copyfmt(ostringstream());
+
+			bool known = true;
+			if(command == "id" && !arg.empty()) {
+				pInterpreter->parserId(arg);
+			} else if(command == "ids") {
+				istringstream ids(line.substr(command.size()));
+				pInterpreter->parserIds(ids);
+			} else if(command == "resolve" && !arg.empty()) {
+				pInterpreter->parserId(arg, config);
+			} else if(command == "style" && !arg.empty()) {
+				pInterpreter->parserStyle(arg, config);
+			} else if(command == "name" && !arg.empty()) {
+				pInterpreter->parserName(arg);
+			} else if(command == "type" && !arg.empty()) {
+				pInterpreter->parserResource(arg);
+			} else {
+				known = false;
+			}
+			sent = known ? sendOk(fd, out.str()) : sendError(fd, "unknown request " + line);
+		}
+		if(!sent) {
+			break;
+		}
+	}
+	close(fd);
+}
+
+int ResourcesServer::run() {
+	for(Table& table : mTables) {
+		table.pParser = loadTable(table.path);
+		if(table.pParser == nullptr) {
+			cout <<"can't load " <<table.path <<endl;
+			return -1;
+		}
+		setFileInfo(table, table.pParser->mFile->getStat());
+	}
+
+	// 客户端提前断开时 send 返回错误, 而不是收到 SIGPIPE 退出
+	signal(SIGPIPE, SIG_IGN);
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(mSocketPath.size() >= sizeof(addr.sun_path)) {
+		cout <<"socket path too long: " <<mSocketPath <<endl;
+		return -1;
+	}
+	strncpy(addr.sun_path, mSocketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+	int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listenFd < 0) {
+		cout <<"socket failed: " <<strerror(errno) <<endl;
+		return -1;
+	}
+	// 上次没有正常退出留下的 socket 文件
+	unlink(mSocketPath.c_str());
+	if(bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, 64) != 0) {
+		cout <<"can't listen on " <<mSocketPath <<": " <<strerror(errno) <<endl;
+		close(listenFd);
+		return -1;
+	}
+
+	thread(&ResourcesServer::watchTables, this).detach();
+	cout <<"serving " <<mTables.size() <<" table(s) on " <<mSocketPath <<endl;
+
+	while(true) {
+		int fd = accept(listenFd, nullptr, nullptr);
+		if(fd < 0) {
+			if(errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			cout <<"accept failed: " <<strerror(errno) <<endl;
+			close(listenFd);
+			return -1;
+		}
+		thread(&ResourcesServer::serveClient, this, fd).detach();
+	}
+}
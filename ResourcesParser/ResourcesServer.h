@@ -0,0 +1,71 @@
+#ifndef RESOURCES_SERVER_H
+#define RESOURCES_SERVER_H
+
+#include "ResourcesParser.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * rp serve: 解析一次, 之后通过 unix domain socket 回答查询.
+ *
+ * 协议是一行一个请求, 每个请求一个回复:
+ *   id <id>                  和 rp -i 一样
+ *   ids <id> <id> ...        和 rp --ids-from 一样
+ *   resolve <id> [config]    和 rp -i id -c config 一样
+ *   style <id> [config]      和 rp -s 一样
+ *   name <[package:]type/name>
+ *   type <type>              和 rp -t 一样
+ *   tables                   列出加载的文件, 每行 "下标 路径"
+ *   use <index>              这个连接之后的查询都用第 index 个文件, 默认是 0
+ *   quit
+ * 成功回复 "OK <字节数>\n" 加上和命令行一样的输出, 失败回复 "ERR <原因>\n".
+ *
+ * 每个连接一个线程. 文件加载后会调用 prepareForSharedReads(), 之后所有线程只读共享同一个
+ * ResourcesParser; 每个连接有自己的 ResourcesResolver 缓存.
+ * 后台线程每秒检查一次文件的 mtime/ctime(精确到纳秒)/大小/inode, 变了就重新加载, 正在处理的查询继续用旧的.
+ */
+class ResourcesServer {
+public:
+	ResourcesServer(const std::string& socketPath, const std::vector<std::string>& tablePaths, int jobCount);
+
+	// 一直运行, 只有出错的时候才返回 -1
+	int run();
+
+private:
+	struct Table {
+		std::string path;
+		// 加载时打开的那个 fd 的信息
+		timespec mtime;
+		timespec ctime;
+		off_t size;
+		ino_t inode;
+		std::shared_ptr<ResourcesParser> pParser;
+	};
+
+	std::string mSocketPath;
+	int mJobCount;
+	// 只保护 Table 里的 pParser 和文件信息, 查询本身不加锁
+	std::mutex mMutex;
+	std::vector<Table> mTables;
+
+	// 解析失败返回 nullptr
+	std::shared_ptr<ResourcesParser> loadTable(const std::string& path);
+
+	static void setFileInfo(Table& table, const struct stat& st);
+
+	// 原地 pwrite 不改变大小和 inode, 同一秒里的两次修改只能靠纳秒和 ctime 区分
+	static bool isSameFileInfo(const Table& a, const Table& b);
+
+	std::shared_ptr<ResourcesParser> getParser(size_t index);
+
+	void watchTables();
+
+	void serveClient(int fd);
+};
+
+#endif  /*RESOURCES_SERVER_H*/
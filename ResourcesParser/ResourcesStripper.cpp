@@ -0,0 +1,240 @@
+#include "ResourcesStripper.h"
+
+#include <iostream>
+#include <algorithm>
+#include <unordered_set>
+#include <string.h>
+
+using namespace std;
+
+// anydpi, ResTable_config 里没有定义这个常量
+static const uint16_t DENSITY_ANY = 0xFFFE;
+
+// 对 type chunk 里每个不同的 entry(多个 id 共用的只算一次)的每个字符串值调用 func
+template<typename F>
+static void forEachStringValue(ResourcesParser::ResTableType* pResTableType, F func) {
+	unordered_set<const ResTable_entry*> visited;
+	for(ResTable_entry* pEntry : pResTableType->entries) {
+		if(pEntry == nullptr || !visited.insert(pEntry).second) {
+			continue;
+		}
+		if(pEntry->flags & ResTable_entry::FLAG_COMPLEX) {
+			ResTable_map* pMap = ResourcesParser::getMapsFromEntry(pEntry);
+			const uint32_t count = ((const ResTable_map_entry*)pEntry)->count;
+			for(uint32_t i = 0 ; i < count ; i++) {
+				if(pMap[i].value.dataType == Res_value::TYPE_STRING) {
+					func(pMap[i].value);
+				}
+			}
+		} else {
+			Res_value* pValue = ResourcesParser::getValueFromEntry(pEntry);
+			if(pValue->dataType == Res_value::TYPE_STRING) {
+				func(*pValue);
+			}
+		}
+	}
+}
+
+bool ResourcesStripper::keepLocale(const string& locale) {
+	ResTable_config config;
+	if(!config.fromString(locale) || config.language[0] == 0) {
+		return false;
+	}
+	// 除了语言和地区以外不能有别的限定符
+	ResTable_config rest = config;
+	rest.locale = 0;
+	if(!rest.toString().empty()) {
+		return false;
+	}
+	mLocales.push_back(config);
+	return true;
+}
+
+bool ResourcesStripper::keepDensity(const string& density) {
+	ResTable_config config;
+	if(!config.fromString(density) || config.density == ResTable_config::DENSITY_DEFAULT) {
+		return false;
+	}
+	ResTable_config rest = config;
+	rest.density = ResTable_config::DENSITY_DEFAULT;
+	if(!rest.toString().empty()) {
+		return false;
+	}
+	mDensities.push_back(config.density);
+	return true;
+}
+
+bool ResourcesStripper::isLocaleKept(const ResTable_config& config) const {
+	if(config.language[0] == 0 || mLocales.empty()) {
+		return true;
+	}
+	for(const ResTable_config& locale : mLocales) {
+		if(memcmp(config.language, locale.language, sizeof(config.language)) == 0
+				&& (locale.country[0] == 0 || memcmp(config.country, locale.country, sizeof(config.country)) == 0)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ResourcesStripper::isKept(const ResTable_config& config) const {
+	if(!isLocaleKept(config)) {
+		return false;
+	}
+	const uint16_t density = config.density;
+	return density == ResTable_config::DENSITY_DEFAULT
+		|| density == ResTable_config::DENSITY_NONE
+		|| density == DENSITY_ANY
+		|| mDensities.empty()
+		|| find(mDensities.begin(), mDensities.end(), density) != mDensities.end();
+}
+
+vector<ResourcesParser::ResTableTypePtr> ResourcesStripper::selectRemoved(
+		const vector<ResourcesParser::ResTableTypePtr>& configs) const {
+	// 保留的 config 里有值的 entry
+	vector<bool> present;
+	vector<ResourcesParser::ResTableTypePtr> candidates;
+	for(ResourcesParser::ResTableTypePtr pResTableType : configs) {
+		pResTableType->load();
+		if(!isKept(pResTableType->header.config)) {
+			candidates.push_back(pResTableType);
+			continue;
+		}
+		const vector<ResTable_entry*>& entries = pResTableType->entries;
+		present.resize(max(present.size(), entries.size()), false);
+		for(uint32_t i = 0 ; i < entries.size() ; i++) {
+			if(entries[i] != nullptr) {
+				present[i] = true;
+			}
+		}
+	}
+
+	// 最接近保留条件的排前面: 先是语言对得上的, 再按密度, 不低于目标密度的越小越好, 其次是低于目标密度的越大越好
+	const uint32_t target = mDensities.empty() ? 0 : *min_element(mDensities.begin(), mDensities.end());
+	auto score = [this, target](const ResTable_config& config) {
+		const uint32_t density = config.density;
+		const uint32_t distance = density >= target ? density - target : 0x10000 + target - density;
+		return make_pair(isLocaleKept(config) ? 0 : 1, distance);
+	};
+	stable_sort(candidates.begin(), candidates.end(),
+			[&score](const ResourcesParser::ResTableTypePtr& a, const ResourcesParser::ResTableTypePtr& b) {
+		return score(a->header.config) < score(b->header.config);
+	});
+
+	vector<ResourcesParser::ResTableTypePtr> removed;
+	for(ResourcesParser::ResTableTypePtr pResTableType : candidates) {
+		const vector<ResTable_entry*>& entries = pResTableType->entries;
+		bool isNeeded = false;
+		for(uint32_t i = 0 ; i < entries.size() && !isNeeded ; i++) {
+			isNeeded = entries[i] != nullptr && (i >= present.size() || !present[i]);
+		}
+		if(!isNeeded) {
+			removed.push_back(pResTableType);
+			continue;
+		}
+		present.resize(max(present.size(), entries.size()), false);
+		for(uint32_t i = 0 ; i < entries.size() ; i++) {
+			if(entries[i] != nullptr) {
+				present[i] = true;
+			}
+		}
+	}
+	return removed;
+}
+
+uint32_t ResourcesStripper::strip() {
+	uint32_t removedConfigs = 0;
+	uint32_t removedSize = 0;
+	for(auto& item : mParser->mResourceForPackageName) {
+		ResourcesParser::PackageResourcePtr pPackage = item.second;
+		unordered_set<const ResourcesParser::ResTableType*> removed;
+		for(auto& types : pPackage->resTablePtrs) {
+			vector<ResourcesParser::ResTableTypePtr>& configs = types.second;
+			const vector<ResourcesParser::ResTableTypePtr> removedConfigsOfType = selectRemoved(configs);
+			if(removedConfigsOfType.empty()) {
+				continue;
+			}
+			for(ResourcesParser::ResTableTypePtr pResTableType : removedConfigsOfType) {
+				removed.insert(pResTableType.get());
+			}
+			configs.erase(remove_if(configs.begin(), configs.end(),
+					[&removed](const ResourcesParser::ResTableTypePtr& pResTableType) {
+				return removed.count(pResTableType.get()) > 0;
+			}), configs.end());
+			mParser->invalidateTypeIndex((pPackage->header.id << 24) | (types.first << 16));
+		}
+		if(removed.empty()) {
+			continue;
+		}
+
+		uint32_t packageRemovedSize = 0;
+		vector<ResourcesParser::ChunkInfo>& chunks = pPackage->chunks;
+		for(const ResourcesParser::ChunkInfo& chunk : chunks) {
+			if(chunk.pResTableType != nullptr && removed.count(chunk.pResTableType.get()) > 0) {
+				packageRemovedSize += chunk.pResTableType->header.header.size;
+			}
+		}
+		chunks.erase(remove_if(chunks.begin(), chunks.end(), [&removed](const ResourcesParser::ChunkInfo& chunk) {
+			return chunk.pResTableType != nullptr && removed.count(chunk.pResTableType.get()) > 0;
+		}), chunks.end());
+		// 少了 chunk 的 package 不能再整个从源文件拷贝
+		pPackage->isDirty = true;
+		pPackage->header.header.size -= packageRemovedSize;
+		mParser->mResourcesInfo.header.size -= packageRemovedSize;
+		removedConfigs += removed.size();
+		removedSize += packageRemovedSize;
+	}
+
+	const uint32_t stringCount = mParser->mGlobalStringPool->header.stringCount;
+	const uint32_t removedStringSize = collectStrings();
+	cout <<"removed " <<removedConfigs <<" configs (" <<removedSize <<" bytes), "
+		<<stringCount - mParser->mGlobalStringPool->header.stringCount <<" strings (" <<removedStringSize <<" bytes)" <<endl;
+	return removedConfigs;
+}
+
+uint32_t ResourcesStripper::collectStrings() {
+	ResourcesParser::ResStringPool* pPool = mParser->mGlobalStringPool.get();
+	vector<bool> keep(pPool->header.stringCount, false);
+	vector<ResourcesParser::ResTableType*> types;
+	for(auto& item : mParser->mResourceForPackageName) {
+		for(const ResourcesParser::ChunkInfo& chunk : item.second->chunks) {
+			if(chunk.pResTableType == nullptr) {
+				continue;
+			}
+			ResourcesParser::ResTableType* pResTableType = chunk.pResTableType.get();
+			pResTableType->load();
+			types.push_back(pResTableType);
+			forEachStringValue(pResTableType, [&keep](Res_value& value) {
+				if(value.data < keep.size()) {
+					keep[value.data] = true;
+				}
+			});
+		}
+	}
+	if(find(keep.begin(), keep.end(), false) == keep.end()) {
+		return 0;
+	}
+
+	vector<uint32_t> remap;
+	const uint32_t removedSize = pPool->removeStrings(keep, remap);
+	mParser->mResourcesInfo.header.size -= removedSize;
+
+	// index 变了的 type chunk 才改, 其余的保存时还能从源文件拷贝
+	for(ResourcesParser::ResTableType* pResTableType : types) {
+		bool isChanged = false;
+		forEachStringValue(pResTableType, [&isChanged, &remap](Res_value& value) {
+			isChanged = isChanged || (value.data < remap.size() && remap[value.data] != value.data);
+		});
+		if(!isChanged) {
+			continue;
+		}
+		pResTableType->makeWritable();
+		pResTableType->isDirty = true;
+		forEachStringValue(pResTableType, [&remap](Res_value& value) {
+			if(value.data < remap.size()) {
+				value.data = remap[value.data];
+			}
+		});
+	}
+	return removedSize;
+}
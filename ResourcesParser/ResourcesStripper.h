@@ -0,0 +1,51 @@
+#ifndef RESOURCES_STRIPPER_H
+#define RESOURCES_STRIPPER_H
+
+#include "ResourceTypes.h"
+#include "ResourcesParser.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * 按语言和密度精简 resources.arsc: 删掉不需要的 config(整个 ResTableType chunk), 再回收全局字符串池里
+ * 不再被任何值引用的字符串, 所有 TYPE_STRING 的值(包括 bag 里的)换成新的 index.
+ *
+ * 要删的 config 里有某个 entry, 而保留的 config 里都没有的话, 这个 config 也留下来, 不会让任何 id 找不到值.
+ * 这样的 config 有好几个时先看最接近保留条件的(语言对得上的, 密度不低于第一个保留密度里最小的).
+ * 只修改内存里的 parser, 之后用 saveToFile 写出去, 没有变化的 chunk 直接从源文件拷贝.
+ */
+class ResourcesStripper {
+public:
+	ResourcesStripper(ResourcesParser* parser) : mParser(parser) {  }
+
+	// "zh" 保留所有 zh 的 config, "zh-rCN" 只保留这一个地区. 没有语言限定的 config 总是保留.
+	// 不是语言限定符时返回 false
+	bool keepLocale(const std::string& locale);
+
+	// "xxhdpi" 或者 "480dpi". 没有密度限定的, nodpi 和 anydpi 的 config 总是保留.
+	// 不是密度限定符时返回 false
+	bool keepDensity(const std::string& density);
+
+	// 删掉不保留的 config 并回收字符串, 返回删掉的 config 数
+	uint32_t strip();
+
+private:
+	ResourcesParser* mParser;
+	std::vector<ResTable_config> mLocales;
+	std::vector<uint16_t> mDensities;
+
+	bool isLocaleKept(const ResTable_config& config) const;
+
+	bool isKept(const ResTable_config& config) const;
+
+	// 一个 type 的所有 config 里要删掉的
+	std::vector<ResourcesParser::ResTableTypePtr> selectRemoved(
+			const std::vector<ResourcesParser::ResTableTypePtr>& configs) const;
+
+	// 回收全局字符串, 返回字符串池减少的字节数
+	uint32_t collectStrings();
+};
+
+#endif  /*RESOURCES_STRIPPER_H*/
@@ -0,0 +1,289 @@
+#include "StringTranscoder.h"
+
+#include <stdint.h>
+#include <memory>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TRANSCODER_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static const char16_t REPLACEMENT_CHAR = 0xFFFD;
+
+// 剩下的字符少于这个数时直接用标量循环, 短字符串上 SIMD 的准备和尾部处理比省下的还多
+static const size_t SIMD_MIN_LEN = 32;
+
+// 不超过这么多字节的结果先转换到栈上的缓冲区, 再按实际长度构造返回值, 不用先分配并清零最大长度
+static const size_t STACK_BUFFER_SIZE = 512;
+
+// ascii 快速路径: 从头开始转换, 遇到第一个非 ascii 字符就停, 返回已处理的字符数
+static size_t asciiUtf16ToUtf8Scalar(const char16_t* pSrc, size_t len, char* pDst) {
+	size_t i = 0;
+	for(; i < len && pSrc[i] < 0x80 ; i++) {
+		pDst[i] = (char)pSrc[i];
+	}
+	return i;
+}
+
+static size_t asciiUtf8ToUtf16Scalar(const char* pSrc, size_t len, char16_t* pDst) {
+	size_t i = 0;
+	for(; i < len && (unsigned char)pSrc[i] < 0x80 ; i++) {
+		pDst[i] = (unsigned char)pSrc[i];
+	}
+	return i;
+}
+
+#ifdef TRANSCODER_X86
+static size_t asciiUtf16ToUtf8Sse2(const char16_t* pSrc, size_t len, char* pDst) {
+	const __m128i mask = _mm_set1_epi16((short)0xFF80);
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for(; i + 8 <= len ; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(pSrc + i));
+		if(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, mask), zero)) != 0xFFFF) {
+			break;
+		}
+		_mm_storel_epi64((__m128i*)(pDst + i), _mm_packus_epi16(v, v));
+	}
+	return i + asciiUtf16ToUtf8Scalar(pSrc + i, len - i, pDst + i);
+}
+
+static size_t asciiUtf8ToUtf16Sse2(const char* pSrc, size_t len, char16_t* pDst) {
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for(; i + 16 <= len ; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(pSrc + i));
+		if(_mm_movemask_epi8(v) != 0) {
+			break;
+		}
+		_mm_storeu_si128((__m128i*)(pDst + i), _mm_unpacklo_epi8(v, zero));
+		_mm_storeu_si128((__m128i*)(pDst + i + 8), _mm_unpackhi_epi8(v, zero));
+	}
+	return i + asciiUtf8ToUtf16Scalar(pSrc + i, len - i, pDst + i);
+}
+
+__attribute__((target("avx2")))
+static size_t asciiUtf16ToUtf8Avx2(const char16_t* pSrc, size_t len, char* pDst) {
+	const __m256i mask = _mm256_set1_epi16((short)0xFF80);
+	size_t i = 0;
+	for(; i + 16 <= len ; i += 16) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(pSrc + i));
+		if(!_mm256_testz_si256(v, mask)) {
+			break;
+		}
+		// packus 是按 128 位 lane 分别打包的, 打包后再把两个 lane 的低 64 位拼到一起
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0xD8);
+		_mm_storeu_si128((__m128i*)(pDst + i), _mm256_castsi256_si128(packed));
+	}
+	// 尾部直接在这里处理, 调用非 VEX 编码的 sse2 版本会有 AVX/SSE 切换的开销
+	for(; i < len && pSrc[i] < 0x80 ; i++) {
+		pDst[i] = (char)pSrc[i];
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t asciiUtf8ToUtf16Avx2(const char* pSrc, size_t len, char16_t* pDst) {
+	size_t i = 0;
+	for(; i + 32 <= len ; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(pSrc + i));
+		if(_mm256_movemask_epi8(v) != 0) {
+			break;
+		}
+		_mm256_storeu_si256((__m256i*)(pDst + i), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+		_mm256_storeu_si256((__m256i*)(pDst + i + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+	}
+	for(; i < len && (unsigned char)pSrc[i] < 0x80 ; i++) {
+		pDst[i] = (unsigned char)pSrc[i];
+	}
+	return i;
+}
+#endif
+
+typedef size_t (*AsciiUtf16ToUtf8Func)(const char16_t* pSrc, size_t len, char* pDst);
+typedef size_t (*AsciiUtf8ToUtf16Func)(const char* pSrc, size_t len, char16_t* pDst);
+
+// 选好的 ascii 快速路径, 只在启动和 setImpl 的时候选一次, 转换时不再判断
+struct AsciiImpl {
+	StringTranscoder::Impl impl;
+	AsciiUtf16ToUtf8Func utf16ToUtf8;
+	AsciiUtf8ToUtf16Func utf8ToUtf16;
+};
+
+static StringTranscoder::Impl detectImpl() {
+#ifdef TRANSCODER_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) {
+		return StringTranscoder::IMPL_AVX2;
+	}
+	if(__builtin_cpu_supports("sse2")) {
+		return StringTranscoder::IMPL_SSE2;
+	}
+#endif
+	return StringTranscoder::IMPL_SCALAR;
+}
+
+static AsciiImpl selectImpl(StringTranscoder::Impl impl) {
+	static const StringTranscoder::Impl detected = detectImpl();
+	if(impl == StringTranscoder::IMPL_AUTO || impl > detected) {
+		impl = detected;
+	}
+	AsciiImpl ascii = { StringTranscoder::IMPL_SCALAR, asciiUtf16ToUtf8Scalar, asciiUtf8ToUtf16Scalar };
+#ifdef TRANSCODER_X86
+	if(impl == StringTranscoder::IMPL_AVX2) {
+		ascii.impl = impl;
+		ascii.utf16ToUtf8 = asciiUtf16ToUtf8Avx2;
+		ascii.utf8ToUtf16 = asciiUtf8ToUtf16Avx2;
+	} else if(impl == StringTranscoder::IMPL_SSE2) {
+		ascii.impl = impl;
+		ascii.utf16ToUtf8 = asciiUtf16ToUtf8Sse2;
+		ascii.utf8ToUtf16 = asciiUtf8ToUtf16Sse2;
+	}
+#endif
+	return ascii;
+}
+
+// 先静态初始化成标量实现, 其他文件的静态初始化里用到也是安全的, 启动时再换成 CPU 支持的
+static AsciiImpl sAscii = { StringTranscoder::IMPL_SCALAR, asciiUtf16ToUtf8Scalar, asciiUtf8ToUtf16Scalar };
+static const bool sAsciiSelected = (sAscii = selectImpl(StringTranscoder::IMPL_AUTO), true);
+
+void StringTranscoder::setImpl(Impl impl) {
+	sAscii = selectImpl(impl);
+}
+
+StringTranscoder::Impl StringTranscoder::getImpl() {
+	return sAscii.impl;
+}
+
+const char* StringTranscoder::getImplName(Impl impl) {
+	switch(impl) {
+		case IMPL_SCALAR:
+			return "scalar";
+		case IMPL_SSE2:
+			return "sse2";
+		case IMPL_AVX2:
+			return "avx2";
+		default:
+			return "auto";
+	}
+}
+
+static inline size_t asciiUtf16ToUtf8(const char16_t* pSrc, size_t len, char* pDst) {
+	return len >= SIMD_MIN_LEN ? sAscii.utf16ToUtf8(pSrc, len, pDst) : asciiUtf16ToUtf8Scalar(pSrc, len, pDst);
+}
+
+static inline size_t asciiUtf8ToUtf16(const char* pSrc, size_t len, char16_t* pDst) {
+	return len >= SIMD_MIN_LEN ? sAscii.utf8ToUtf16(pSrc, len, pDst) : asciiUtf8ToUtf16Scalar(pSrc, len, pDst);
+}
+
+// pDst 至少要有 len * 3 个字节: 一个 utf16 单元最多 3 个字节, 代理对是 2 个单元 4 个字节. 返回写入的字节数
+static size_t transcodeUtf16ToUtf8(const char16_t* pStr, size_t len, char* pDst) {
+	size_t out = 0;
+	size_t i = 0;
+	while(i < len) {
+		size_t n = asciiUtf16ToUtf8(pStr + i, len - i, pDst + out);
+		i += n;
+		out += n;
+
+		// 非 ascii 部分逐个处理, 直到遇到下一个 ascii
+		while(i < len && pStr[i] >= 0x80) {
+			uint32_t c = pStr[i++];
+			if(c >= 0xD800 && c <= 0xDBFF && i < len && pStr[i] >= 0xDC00 && pStr[i] <= 0xDFFF) {
+				c = 0x10000 + ((c - 0xD800) << 10) + (pStr[i++] - 0xDC00);
+			} else if(c >= 0xD800 && c <= 0xDFFF) {
+				c = REPLACEMENT_CHAR;
+			}
+
+			if(c < 0x800) {
+				pDst[out++] = (char)(0xC0 | (c >> 6));
+				pDst[out++] = (char)(0x80 | (c & 0x3F));
+			} else if(c < 0x10000) {
+				pDst[out++] = (char)(0xE0 | (c >> 12));
+				pDst[out++] = (char)(0x80 | ((c >> 6) & 0x3F));
+				pDst[out++] = (char)(0x80 | (c & 0x3F));
+			} else {
+				pDst[out++] = (char)(0xF0 | (c >> 18));
+				pDst[out++] = (char)(0x80 | ((c >> 12) & 0x3F));
+				pDst[out++] = (char)(0x80 | ((c >> 6) & 0x3F));
+				pDst[out++] = (char)(0x80 | (c & 0x3F));
+			}
+		}
+	}
+	return out;
+}
+
+string StringTranscoder::utf16ToUtf8(const char16_t* pStr, size_t len) {
+	if(len * 3 <= STACK_BUFFER_SIZE) {
+		char buf[STACK_BUFFER_SIZE];
+		return string(buf, transcodeUtf16ToUtf8(pStr, len, buf));
+	}
+	unique_ptr<char[]> pBuf(new char[len * 3]);
+	return string(pBuf.get(), transcodeUtf16ToUtf8(pStr, len, pBuf.get()));
+}
+
+// pDst 至少要有 len 个单元: 每个字节最多产生一个 utf16 单元. 返回写入的单元数
+static size_t transcodeUtf8ToUtf16(const char* pStr, size_t len, char16_t* pDst) {
+	const unsigned char* pSrc = (const unsigned char*)pStr;
+	size_t out = 0;
+	size_t i = 0;
+	while(i < len) {
+		size_t n = asciiUtf8ToUtf16(pStr + i, len - i, pDst + out);
+		i += n;
+		out += n;
+
+		while(i < len && pSrc[i] >= 0x80) {
+			uint32_t c = pSrc[i];
+			size_t extra = 0;
+			uint32_t min = 0;
+			if((c & 0xE0) == 0xC0) {
+				c &= 0x1F;
+				extra = 1;
+				min = 0x80;
+			} else if((c & 0xF0) == 0xE0) {
+				c &= 0x0F;
+				extra = 2;
+				min = 0x800;
+			} else if((c & 0xF8) == 0xF0) {
+				c &= 0x07;
+				extra = 3;
+				min = 0x10000;
+			} else {
+				pDst[out++] = REPLACEMENT_CHAR;
+				i++;
+				continue;
+			}
+
+			size_t j = 1;
+			for(; j <= extra && i + j < len && (pSrc[i + j] & 0xC0) == 0x80 ; j++) {
+				c = (c << 6) | (pSrc[i + j] & 0x3F);
+			}
+			if(j <= extra || c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+				// 截断/过长编码/非法码点, 跳过已经看过的字节
+				pDst[out++] = REPLACEMENT_CHAR;
+				i += j;
+				continue;
+			}
+			i += j;
+
+			if(c >= 0x10000) {
+				c -= 0x10000;
+				pDst[out++] = (char16_t)(0xD800 + (c >> 10));
+				pDst[out++] = (char16_t)(0xDC00 + (c & 0x3FF));
+			} else {
+				pDst[out++] = (char16_t)c;
+			}
+		}
+	}
+	return out;
+}
+
+u16string StringTranscoder::utf8ToUtf16(const char* pStr, size_t len) {
+	if(len * sizeof(char16_t) <= STACK_BUFFER_SIZE) {
+		char16_t buf[STACK_BUFFER_SIZE / sizeof(char16_t)];
+		return u16string(buf, transcodeUtf8ToUtf16(pStr, len, buf));
+	}
+	unique_ptr<char16_t[]> pBuf(new char16_t[len]);
+	return u16string(pBuf.get(), transcodeUtf8ToUtf16(pStr, len, pBuf.get()));
+}
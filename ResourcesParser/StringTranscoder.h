@@ -0,0 +1,44 @@
+#ifndef STRING_TRANSCODER_H
+#define STRING_TRANSCODER_H
+
+#include <string>
+#include <stddef.h>
+
+/**
+ * 字符串池用到的 UTF-16 <-> UTF-8 转换.
+ *
+ * 字符串池里绝大多数都是纯 ascii, 所以先用 SIMD 一次处理 8/16 个字符的 ascii 部分,
+ * 遇到非 ascii 再逐个字符处理. SSE2/AVX2 在启动时按 CPU 选好一次, 非 x86 只有标量实现.
+ * 池里的字符串大多很短, 剩下不到 32 个字符时 SIMD 不划算, 直接用标量循环.
+ * 不合法的输入(落单的代理项, 错误的 utf8 序列)会被替换成 U+FFFD, 不会抛异常.
+ */
+class StringTranscoder {
+public:
+	enum Impl {
+		IMPL_AUTO,
+		IMPL_SCALAR,
+		IMPL_SSE2,
+		IMPL_AVX2
+	};
+
+	static std::string utf16ToUtf8(const char16_t* pStr, size_t len);
+
+	static std::string utf16ToUtf8(const std::u16string& str16) {
+		return utf16ToUtf8(str16.data(), str16.size());
+	}
+
+	static std::u16string utf8ToUtf16(const char* pStr, size_t len);
+
+	static std::u16string utf8ToUtf16(const std::string& strUtf8) {
+		return utf8ToUtf16(strUtf8.data(), strUtf8.size());
+	}
+
+	// 强制使用某个实现(CPU 不支持时退回能用的), 给 benchmark 用
+	static void setImpl(Impl impl);
+
+	static Impl getImpl();
+
+	static const char* getImplName(Impl impl);
+};
+
+#endif  /*STRING_TRANSCODER_H*/
@@ -0,0 +1,118 @@
+// 字符串池转码的 microbenchmark: 旧的 wstring_convert 和 StringTranscoder 各实现对比.
+//
+// make bench_transcode && ./bench_transcode [resources.arsc] [rounds]
+
+#include "ResourcesParser.h"
+#include "StringTranscoder.h"
+
+#include <codecvt>
+#include <locale>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double elapsedMs(Clock::time_point start) {
+	return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+static void report(const string& name, double ms16to8, double ms8to16, size_t count, int rounds, bool same) {
+	cout <<setw(10) <<name
+		<<setw(14) <<fixed <<setprecision(1) <<ms16to8 * 1e6 / (count * rounds)
+		<<setw(14) <<ms8to16 * 1e6 / (count * rounds)
+		<<"   " <<(same ? "ok" : "MISMATCH") <<endl;
+}
+
+int main(int argc, char *argv[]) {
+	const char* path = argc > 1 ? argv[1] : "resources.arsc";
+	const int rounds = argc > 2 ? atoi(argv[2]) : 200;
+
+	ResourcesParser::setDebugLog(false);
+	ResourcesParser parser(path, ResourcesFile::LOAD_MMAP);
+
+	// 把所有字符串池的内容都收集起来, 作为两个方向的输入
+	vector<ResourcesParser::ResStringPoolPtr> pools;
+	pools.push_back(parser.mGlobalStringPool);
+	for(auto it : parser.getResourceForPackageName()) {
+		pools.push_back(it.second->pTypes);
+		pools.push_back(it.second->pKeys);
+	}
+	vector<string> strs8;
+	vector<u16string> strs16;
+	size_t bytes = 0;
+	for(auto pPool : pools) {
+		for(uint32_t i = 0 ; pPool && i < pPool->header.stringCount ; i++) {
+			const string& str = ResourcesParser::getStringFromResStringPool(pPool, i);
+			strs8.push_back(str);
+			strs16.push_back(wstring_convert<codecvt_utf8_utf16<char16_t>, char16_t>().from_bytes(str));
+			bytes += str.size();
+		}
+	}
+	if(strs8.empty()) {
+		cout <<"no strings in " <<path <<endl;
+		return -1;
+	}
+
+	cout <<endl <<strs8.size() <<" strings, " <<bytes <<" utf8 bytes, " <<rounds <<" rounds" <<endl;
+	cout <<setw(10) <<"impl" <<setw(14) <<"16->8 ns/str" <<setw(14) <<"8->16 ns/str" <<endl;
+
+	size_t sink = 0;
+	{
+		Clock::time_point start = Clock::now();
+		for(int r = 0 ; r < rounds ; r++) {
+			for(const u16string& str : strs16) {
+				sink += wstring_convert<codecvt_utf8_utf16<char16_t>, char16_t>().to_bytes(str).size();
+			}
+		}
+		double ms16to8 = elapsedMs(start);
+		start = Clock::now();
+		for(int r = 0 ; r < rounds ; r++) {
+			for(const string& str : strs8) {
+				sink += wstring_convert<codecvt_utf8_utf16<char16_t>, char16_t>().from_bytes(str).size();
+			}
+		}
+		report("codecvt", ms16to8, elapsedMs(start), strs8.size(), rounds, true);
+	}
+
+	const StringTranscoder::Impl impls[] = {
+		StringTranscoder::IMPL_SCALAR,
+		StringTranscoder::IMPL_SSE2,
+		StringTranscoder::IMPL_AVX2
+	};
+	for(StringTranscoder::Impl impl : impls) {
+		StringTranscoder::setImpl(impl);
+		if(StringTranscoder::getImpl() != impl) {
+			cout <<setw(10) <<StringTranscoder::getImplName(impl) <<"   (not supported by this cpu)" <<endl;
+			continue;
+		}
+
+		bool same = true;
+		for(size_t i = 0 ; i < strs8.size() ; i++) {
+			same = same
+				&& StringTranscoder::utf16ToUtf8(strs16[i]) == strs8[i]
+				&& StringTranscoder::utf8ToUtf16(strs8[i]) == strs16[i];
+		}
+
+		Clock::time_point start = Clock::now();
+		for(int r = 0 ; r < rounds ; r++) {
+			for(const u16string& str : strs16) {
+				sink += StringTranscoder::utf16ToUtf8(str).size();
+			}
+		}
+		double ms16to8 = elapsedMs(start);
+		start = Clock::now();
+		for(int r = 0 ; r < rounds ; r++) {
+			for(const string& str : strs8) {
+				sink += StringTranscoder::utf8ToUtf16(str).size();
+			}
+		}
+		report(StringTranscoder::getImplName(impl), ms16to8, elapsedMs(start), strs8.size(), rounds, same);
+	}
+	StringTranscoder::setImpl(StringTranscoder::IMPL_AUTO);
+
+	return sink == 0 ? -1 : 0;
+}
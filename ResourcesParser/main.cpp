@@ -1,20 +1,50 @@
 #include "ResourcesParser.h"
 #include "ResourcesParserInterpreter.h"
+#include "ResourcesServer.h"
+#include "ResourcesIndex.h"
+#include "EditSession.h"
+#include "ResourcesStripper.h"
 
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std;
 
 int findArgvIndex(const char* argv, char *argvs[], int count);
 const char* getArgv(const char* argv, char *argvs[], int count);
 void printHelp();
+int serve(char *argv[], int argc);
+int setValue(char *argv[], int argc);
+int strip(char *argv[], int argc);
 
 int main(int argc, char *argv[]) {
+	if(argc > 1 && strcmp(argv[1], "serve") == 0) {
+		return serve(argv, argc);
+	}
+	if(argc > 1 && strcmp(argv[1], "set-value") == 0) {
+		return setValue(argv, argc);
+	}
+	if(argc > 1 && strcmp(argv[1], "strip") == 0) {
+		return strip(argv, argc);
+	}
+
 	const char* path = getArgv("-p", argv, argc);
 	const char* type = getArgv("-t", argv, argc);
 	const char* id = getArgv("-i", argv, argc);
+	const char* name = getArgv("-n", argv, argc);
+	const char* config = getArgv("-c", argv, argc);
+	const char* style = getArgv("-s", argv, argc);
+	const char* idsFrom = getArgv("--ids-from", argv, argc);
 	int all = findArgvIndex("-a", argv, argc);
+	int mmap = findArgvIndex("-m", argv, argc);
+	int useIndex = findArgvIndex("-x", argv, argc);
+	const char* jobs = getArgv("-j", argv, argc);
 
 	if(nullptr == path) {
 		printHelp();
@@ -23,7 +53,22 @@ int main(int argc, char *argv[]) {
 		printHelp();
 	}
 
-	ResourcesParser parser(path);
+	if(idsFrom) {
+		// 批量查询的输出只有查询结果
+		ResourcesParser::setDebugLog(false);
+	}
+
+	const string indexPath = useIndex >= 0 ? string(path) + ".rpidx" : "";
+	ResourcesParser parser(path, mmap >= 0 ? ResourcesFile::LOAD_MMAP : ResourcesFile::LOAD_STREAM, indexPath);
+	if(useIndex >= 0 && !parser.isRestoredFromIndex() && parser.mGlobalStringPool != nullptr) {
+		// 在查询之前写, 写的是没有修改过的解析结果
+		if(!ResourcesIndex::write(indexPath, path, parser)) {
+			cout <<"can't write " <<indexPath <<endl;
+		}
+	}
+	if(jobs) {
+		parser.loadAllResTableTypes(atoi(jobs));
+	}
 	ResourcesParserInterpreter interpreter(&parser);
 
 	if(all >= 0) {
@@ -34,9 +79,203 @@ int main(int argc, char *argv[]) {
 		interpreter.parserResource(type);
 	}
 
-	if(id) {
+	if(id && config) {
+		interpreter.parserId(id, config);
+	} else if(id) {
 		interpreter.parserId(id);
 	}
+
+	if(idsFrom) {
+		if(strcmp(idsFrom, "-") == 0) {
+			interpreter.parserIds(cin);
+		} else {
+			ifstream in(idsFrom);
+			if(!in) {
+				cout <<"can't open " <<idsFrom <<endl;
+				return -1;
+			}
+			interpreter.parserIds(in);
+		}
+	}
+
+	if(style) {
+		interpreter.parserStyle(style, config ? config : "");
+	}
+
+	if(name) {
+		interpreter.parserName(name);
+	}
+	return 0;
+}
+
+int serve(char *argv[], int argc) {
+	// 可以有多个 -p, 按出现的顺序编号
+	vector<string> paths;
+	for(int i = 2 ; i + 1 < argc ; i++) {
+		if(strcmp(argv[i], "-p") == 0) {
+			paths.push_back(argv[++i]);
+		}
+	}
+	const char* socketPath = getArgv("--socket", argv, argc);
+	const char* jobs = getArgv("-j", argv, argc);
+	if(paths.empty() || socketPath == nullptr) {
+		printHelp();
+		return -1;
+	}
+
+	ResourcesParser::setDebugLog(false);
+	ResourcesServer server(socketPath, paths, jobs ? atoi(jobs) : 0);
+	return server.run();
+}
+
+// 把命令行上的 type 和 data 转成 Res_value, type 不认识或者 data 格式不对返回 false
+static bool parseValue(const string& type, const string& data, uint8_t& dataType, uint32_t& value) {
+	char* end = nullptr;
+	if(type == "reference" || type == "attribute" || type == "hex") {
+		dataType = type == "reference" ? Res_value::TYPE_REFERENCE
+			: type == "attribute" ? Res_value::TYPE_ATTRIBUTE : Res_value::TYPE_INT_HEX;
+		value = strtoul(data.c_str(), &end, 0);
+	} else if(type == "int") {
+		dataType = Res_value::TYPE_INT_DEC;
+		value = strtol(data.c_str(), &end, 0);
+	} else if(type == "bool") {
+		// 和 aapt 一样, true 是 0xffffffff
+		dataType = Res_value::TYPE_INT_BOOLEAN;
+		value = data == "true" ? 0xffffffff : 0;
+		return data == "true" || data == "false";
+	} else if(type == "float") {
+		float f = strtof(data.c_str(), &end);
+		dataType = Res_value::TYPE_FLOAT;
+		memcpy(&value, &f, sizeof(value));
+	} else if(type == "color") {
+		// #rrggbb 或者 #aarrggbb
+		if(data.size() != 7 && data.size() != 9) {
+			return false;
+		}
+		dataType = data.size() == 7 ? Res_value::TYPE_INT_COLOR_RGB8 : Res_value::TYPE_INT_COLOR_ARGB8;
+		value = strtoul(data.c_str() + 1, &end, 16) | (data.size() == 7 ? 0xff000000 : 0);
+		return data[0] == '#' && *end == '\0';
+	} else {
+		return false;
+	}
+	return !data.empty() && *end == '\0';
+}
+
+int setValue(char *argv[], int argc) {
+	const char* path = getArgv("-p", argv, argc);
+	const char* out = getArgv("-o", argv, argc);
+	if(argc < 6 || path == nullptr) {
+		printHelp();
+		return -1;
+	}
+	const string type = argv[4];
+	const string data = argv[5];
+
+	ResourcesParser::setDebugLog(false);
+	ResourcesParser parser(path, ResourcesFile::LOAD_MMAP);
+	if(parser.mGlobalStringPool == nullptr) {
+		cout <<"can't load " <<path <<endl;
+		return -1;
+	}
+
+	EditSession session(&parser);
+	const uint32_t id = strtoul(argv[2], nullptr, 0);
+	uint8_t dataType = 0;
+	uint32_t value = 0;
+	bool recorded = false;
+	if(type == "string") {
+		recorded = session.setValue(id, argv[3], data);
+	} else if(parseValue(type, data, dataType, value)) {
+		recorded = session.setValue(id, argv[3], dataType, value);
+	} else {
+		cout <<"bad value " <<type <<" " <<data <<endl;
+		return -1;
+	}
+	if(!recorded) {
+		cout <<"no simple value of " <<argv[2] <<" in config " <<argv[3] <<endl;
+		return -1;
+	}
+
+	// 所有 chunk 大小都不变的话只写改动的字节, 否则整个文件重新写
+	const string dest = out ? out : path;
+	if(session.isInPlace()) {
+		// -o 换个路径(相对路径, 符号链接, 硬链接)指向源文件时也直接改源文件, 不能截断正在读的文件.
+		// 否则先拷贝到目标目录里的临时文件, 改完再 rename 过去
+		const bool isSource = parser.mFile->isSameFile(dest);
+		const string patchPath = isSource ? dest : dest + ".tmp";
+		if(!isSource) {
+			int fd = open(patchPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			bool copied = fd >= 0 && parser.mFile->copyTo(fd, 0, parser.mFile->size(), 0);
+			copied = fd >= 0 && close(fd) == 0 && copied;
+			if(!copied) {
+				cout <<"can't copy " <<path <<" to " <<patchPath <<endl;
+				unlink(patchPath.c_str());
+				return -1;
+			}
+		}
+		int64_t written = session.commitInPlace(patchPath);
+		if(!isSource && (written < 0 || rename(patchPath.c_str(), dest.c_str()) != 0)) {
+			cout <<"can't write " <<dest <<endl;
+			unlink(patchPath.c_str());
+			return -1;
+		}
+		if(written < 0) {
+			return -1;
+		}
+		cout <<"patched " <<written <<" bytes in " <<dest <<endl;
+		return 0;
+	}
+	session.commit();
+	if(!parser.saveToFile(dest)) {
+		return -1;
+	}
+	cout <<"rewrote " <<dest <<endl;
+	return 0;
+}
+
+// 逗号分隔的每一项都交给 keep, 有一项不认识就返回 false
+template<typename F>
+static bool forEachListItem(const char* list, F keep) {
+	istringstream items(list);
+	string item;
+	while(getline(items, item, ',')) {
+		if(!item.empty() && !keep(item)) {
+			cout <<"bad qualifier " <<item <<endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int strip(char *argv[], int argc) {
+	const char* path = getArgv("-p", argv, argc);
+	const char* out = getArgv("-o", argv, argc);
+	const char* locales = getArgv("--keep-locales", argv, argc);
+	const char* densities = getArgv("--keep-density", argv, argc);
+	if(path == nullptr || (locales == nullptr && densities == nullptr)) {
+		printHelp();
+		return -1;
+	}
+
+	ResourcesParser::setDebugLog(false);
+	ResourcesParser parser(path, ResourcesFile::LOAD_MMAP);
+	if(parser.mGlobalStringPool == nullptr) {
+		cout <<"can't load " <<path <<endl;
+		return -1;
+	}
+
+	ResourcesStripper stripper(&parser);
+	if((locales && !forEachListItem(locales, [&stripper](const string& item) { return stripper.keepLocale(item); }))
+			|| (densities && !forEachListItem(densities, [&stripper](const string& item) { return stripper.keepDensity(item); }))) {
+		return -1;
+	}
+	stripper.strip();
+
+	const string dest = out ? out : path;
+	if(!parser.saveToFile(dest)) {
+		return -1;
+	}
+	cout <<"wrote " <<dest <<" (" <<parser.mResourcesInfo.header.size <<" bytes)" <<endl;
 	return 0;
 }
 
@@ -58,9 +297,33 @@ const char* getArgv(const char* argv, char *argvs[], int count) {
 }
 
 void printHelp() {
-	cout <<"rp -p path [-a] [-t type] [-i id]" <<endl<<endl;
+	cout <<"rp -p path [-m] [-x] [-j N] [-a] [-t type] [-i id [-c config]] [-s id [-c config]] [-n type/name] [--ids-from file|-]" <<endl<<endl;
 	cout <<"-p : set path of resources.arsc" <<endl;
 	cout <<"-a : show all of resources.arsc" <<endl;
 	cout <<"-t : select the type in resources.arsc to show" <<endl;
 	cout <<"-i : select the id of resource to show" <<endl;
+	cout <<"-s : show a style with the attributes of all its parents merged in" <<endl;
+	cout <<"-c : with -i, only show the value picked for this device config, e.g. en-rUS-xhdpi-v28," <<endl;
+	cout <<"     references are followed to their final value" <<endl;
+	cout <<"     with -s, pick the style and its parents for this device config" <<endl;
+	cout <<"-n : show the id of resource [package:]type/name" <<endl;
+	cout <<"--ids-from : query every id listed in file (- for stdin) with one parse, results in input order" <<endl;
+	cout <<"-m : load resources.arsc with mmap instead of copying it into memory" <<endl;
+	cout <<"-x : use the index cached in path.rpidx, or build it when it is missing or out of date" <<endl;
+	cout <<"-j : parse all type chunks up front with N threads (0 means one per core)" <<endl<<endl;
+	cout <<"rp serve -p path [-p path ...] --socket socket [-j N]" <<endl<<endl;
+	cout <<"load the files once and answer queries on a unix domain socket, one request per line:" <<endl;
+	cout <<"     id <id> | ids <id> ... | resolve <id> [config] | style <id> [config] | name <type/name> | type <type>" <<endl;
+	cout <<"     tables | use <index> | quit" <<endl;
+	cout <<"     replies are \"OK <bytes>\\n\" followed by the same output as the options above, or \"ERR <reason>\\n\"" <<endl;
+	cout <<"     files are reloaded when their mtime changes" <<endl<<endl;
+	cout <<"rp set-value id config type data -p path [-o out]" <<endl<<endl;
+	cout <<"change the value of id in config (default for the default config), type is one of" <<endl;
+	cout <<"     string | reference | attribute | int | hex | bool | float | color (#rrggbb or #aarrggbb)" <<endl;
+	cout <<"     when no chunk changes size only the changed value is written into path (or a copy of it at out)," <<endl;
+	cout <<"     otherwise the whole file is rewritten" <<endl<<endl;
+	cout <<"rp strip -p path [-o out] [--keep-locales en,zh-rCN] [--keep-density xxhdpi,xhdpi]" <<endl<<endl;
+	cout <<"remove the configs of other locales and densities and the global strings only they used" <<endl;
+	cout <<"     configs without a locale or density (and nodpi/anydpi) are always kept, so is a config that" <<endl;
+	cout <<"     holds the only value of some resource; the result is written to path (or out)" <<endl;
 }